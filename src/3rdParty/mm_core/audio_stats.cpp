@@ -0,0 +1,128 @@
+#include "audio_stats.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+
+AudioHistogram::AudioHistogram(uint32_t width_, int buckets_) :
+  width(width_ ? width_ : 1),
+  bucketCount(buckets_ < 1 ? 1 : (buckets_ > MAX_BUCKETS ? MAX_BUCKETS : buckets_))
+{
+  reset();
+}
+
+
+void AudioHistogram::add(uint32_t value)
+{
+  uint32_t bucket = value / width;
+
+  if (bucket >= uint32_t(bucketCount))
+    bucket = bucketCount - 1;
+
+  buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  count.fetch_add(1, std::memory_order_relaxed);
+  sum.fetch_add(value, std::memory_order_relaxed);
+
+  uint32_t prev = maxValue.load(std::memory_order_relaxed);
+
+  while (value > prev && !maxValue.compare_exchange_weak(prev, value, std::memory_order_relaxed))
+    ;
+}
+
+
+void AudioHistogram::reset()
+{
+  for (int i = 0; i < MAX_BUCKETS; i++)
+    buckets[i].store(0, std::memory_order_relaxed);
+
+  count.store(0, std::memory_order_relaxed);
+  sum.store(0, std::memory_order_relaxed);
+  maxValue.store(0, std::memory_order_relaxed);
+}
+
+
+double AudioHistogram::getMean() const
+{
+  uint32_t n = getCount();
+  return n ? double(sum.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+
+uint32_t AudioHistogram::getPercentile(double fraction) const
+{
+  uint32_t total = 0;
+
+  for (int i = 0; i < bucketCount; i++)
+    total += buckets[i].load(std::memory_order_relaxed);
+
+  if (!total)
+    return 0;
+
+  uint32_t target = uint32_t(fraction * total);
+  uint32_t accumulated = 0;
+
+  for (int i = 0; i < bucketCount - 1; i++)
+  {
+    accumulated += buckets[i].load(std::memory_order_relaxed);
+
+    if (accumulated > target)
+      return std::min((i + 1) * width - 1, getMax());
+  }
+
+  return getMax();
+}
+
+
+void AudioHistogram::print(const char * name, const char * unit) const
+{
+  printf("  %s: count %u, mean %.1f%s, p50 %u, p99 %u, max %u%s\n", name, getCount(), getMean(), unit,
+         getPercentile(0.5), getPercentile(0.99), getMax(), unit);
+}
+
+
+AudioStats::AudioStats() :
+  callbackUsec(25, 48),
+  loadPercent(5, 21),
+  activeVoices(1, 33)
+{
+  reset();
+}
+
+
+void AudioStats::reset()
+{
+  callbackUsec.reset();
+  loadPercent.reset();
+  activeVoices.reset();
+  callbacks.store(0, std::memory_order_relaxed);
+  renderedFrames.store(0, std::memory_order_relaxed);
+  droppedPlays.store(0, std::memory_order_relaxed);
+  stolenVoices.store(0, std::memory_order_relaxed);
+  lateStarts.store(0, std::memory_order_relaxed);
+  queueOverflows.store(0, std::memory_order_relaxed);
+  xruns.store(0, std::memory_order_relaxed);
+  restarts.store(0, std::memory_order_relaxed);
+}
+
+
+void AudioStats::print() const
+{
+  printf("Audio stats:\n");
+  printf("  callbacks: %u, frames: %u\n", callbacks.load(std::memory_order_relaxed),
+         renderedFrames.load(std::memory_order_relaxed));
+  callbackUsec.print("callback time", " usec");
+  loadPercent.print("callback load", "%");
+  activeVoices.print("active voices", "");
+  printf("  dropped plays: %u, stolen voices: %u, late starts: %u\n",
+         droppedPlays.load(std::memory_order_relaxed), stolenVoices.load(std::memory_order_relaxed),
+         lateStarts.load(std::memory_order_relaxed));
+  printf("  queue overflows: %u, xruns: %u, restarts: %u\n", queueOverflows.load(std::memory_order_relaxed),
+         xruns.load(std::memory_order_relaxed), restarts.load(std::memory_order_relaxed));
+}
+
+
+AudioStats & mmc_audio_stats()
+{
+  static AudioStats stats;
+  return stats;
+}
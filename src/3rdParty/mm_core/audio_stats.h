@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free audio engine statistics. Written by the audio thread (and the game thread for
+// play requests), read from any thread. MMC_AUDIO_STATS environment variable makes
+// the FMOD subset print them on release.
+
+// linear buckets of 'width', the last bucket collects everything above
+class AudioHistogram
+{
+public:
+  static const int MAX_BUCKETS = 48;
+
+  AudioHistogram(uint32_t width, int buckets);
+
+  void add(uint32_t value);
+  void reset();
+
+  uint32_t getCount() const { return count.load(std::memory_order_relaxed); }
+  uint32_t getMax() const { return maxValue.load(std::memory_order_relaxed); }
+  double getMean() const;
+  uint32_t getPercentile(double fraction) const; // upper bound of the bucket
+
+  void print(const char * name, const char * unit) const;
+
+private:
+  uint32_t width;
+  int bucketCount;
+  std::atomic<uint32_t> buckets[MAX_BUCKETS];
+  std::atomic<uint32_t> count;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint32_t> maxValue;
+};
+
+
+struct AudioStats
+{
+  AudioHistogram callbackUsec;   // duration of one play callback
+  AudioHistogram loadPercent;    // callback duration relative to the audio it rendered, 100 - headroom
+  AudioHistogram activeVoices;   // voices busy per callback
+  std::atomic<uint32_t> callbacks;
+  std::atomic<uint32_t> renderedFrames;
+  std::atomic<uint32_t> droppedPlays;   // no voice free or stealable
+  std::atomic<uint32_t> stolenVoices;   // cut to start a more important or newer sound
+  std::atomic<uint32_t> lateStarts;     // scheduled start clock already mixed
+  std::atomic<uint32_t> queueOverflows; // mixer command queue full
+  std::atomic<uint32_t> xruns;
+  std::atomic<uint32_t> restarts;      // output recreated
+
+  AudioStats();
+  void reset();
+  void print() const;
+};
+
+AudioStats & mmc_audio_stats();
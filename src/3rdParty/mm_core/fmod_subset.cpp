@@ -8,16 +8,37 @@
 #define MINIMP3_FLOAT_OUTPUT
 #include "minimp3.h"
 #include "minimp3_ex.h"
+#include "mp3_stream.h"
+#include "mix_kernel.h"
+#include "resampler.h"
+#include "audio_stats.h"
 #include <signal.h>
-#include "pthread_sys_lock.h"
-
-MutexLock cs;
+#include <algorithm>
+#include "spsc_queue.h"
 
 static bool quited = false;
+static IPcmOutput * output = NULL;
+
+// the output is recreated after a failure with exponential backoff
+#define OUTPUT_RESTART_DELAY_MIN_MSEC 100
+#define OUTPUT_RESTART_DELAY_MAX_MSEC 5000
+static uint32_t restart_time = 0;
+static uint32_t restart_delay = OUTPUT_RESTART_DELAY_MIN_MSEC;
+static bool system_initialized = false;
+// measured latency is printed once the output has been running for a while
+#define OUTPUT_LATENCY_REPORT_MSEC 1000
+static uint32_t output_start_time = 0;
+static bool latency_reported = false;
 
 #define MAX_FMOD_CHANNELS 1024
 static FMOD::Channel fmod_channels[MAX_FMOD_CHANNELS];
-static int used_channels = 0;
+// channels not bound to a voice, owned by the game thread
+static int free_channels[MAX_FMOD_CHANNELS];
+static int free_channel_count = 0;
+
+#define MAX_FMOD_SOUND_GROUPS 64
+static FMOD::SoundGroup fmod_sound_groups[MAX_FMOD_SOUND_GROUPS];
+static int used_sound_groups = 0;
 
 #define MAX_FMOD_SOUNDS 1024
 static FMOD::Sound fmod_sounds[MAX_FMOD_SOUNDS];
@@ -25,14 +46,17 @@ static int used_sounds = 0;
 
 struct PlaySnd
 {
-  FMOD::Channel * originChannel;
-  float * data;
-  double playPos;
-  float advance;
+  FMOD::Sound * sound;
+  Mp3Stream * stream;
+  MixVoice mix;
   float volume;
-  int beginSample;
-  int endSample;
-  bool loop;
+  int channel;
+  int priority;
+  FMOD::SoundGroup * group;
+  int maxAudible; // of the group when the voice was started
+  FMOD_SOUNDGROUP_BEHAVIOR behavior;
+  uint32_t startSeq;
+  uint64_t startClock; // mixer clock of the first frame, 0 = at once
   bool playing;
 
   void reset()
@@ -41,13 +65,369 @@ struct PlaySnd
   }
 };
 
+enum MixerCommandType
+{
+  cmdPlay,
+  cmdStopSound,
+  cmdSetVolume
+};
 
+struct MixerCommand
+{
+  MixerCommandType type;
+  uint32_t seq;
+  FMOD::Sound * sound;
+  int channel;
+  float volume;
+  PlaySnd voice; // cmdPlay only
+};
+
+
+// Voices and channel volumes are owned by the mixer. The game thread changes them
+// only through the command queue, which the mixer drains at the start of every buffer,
+// so the audio thread never waits for the game thread.
+// A voice slot is in use while its 'sound' is set.
 #define MAX_FMOD_PLAYING_SOUNDS 32
 static PlaySnd playSnd[MAX_FMOD_PLAYING_SOUNDS];
+static int free_voices[MAX_FMOD_PLAYING_SOUNDS];
+static int free_voice_count = 0;
+static float channel_volumes[MAX_FMOD_CHANNELS];
+
+// frames mixed so far; the clock at the start of the last buffer and the time it was
+// taken are published for getDSPClock under a sequence lock
+static uint64_t dsp_clock = 0;
+static std::atomic<uint32_t> anchor_seq(0);
+static std::atomic<uint64_t> anchor_clock(0);
+static std::atomic<uint64_t> anchor_usec(0);
+
+#define MIXER_COMMAND_QUEUE_SIZE 256
+static SpscQueue<MixerCommand, MIXER_COMMAND_QUEUE_SIZE> mixer_commands;
+// channels of ended, stolen and dropped voices go back to the game thread;
+// every channel is in the queue at most once, so it never overflows
+static SpscQueue<int, MAX_FMOD_CHANNELS> released_channels;
+static uint32_t posted_seq = 0;
+static std::atomic<uint32_t> processed_seq(0);
+
+
+static bool is_mixer_running()
+{
+  return output && !quited && !output->needRestart();
+}
+
+
+static void init_voices()
+{
+  for (int i = 0; i < MAX_FMOD_PLAYING_SOUNDS; i++)
+  {
+    playSnd[i].reset();
+    free_voices[i] = MAX_FMOD_PLAYING_SOUNDS - 1 - i;
+  }
+
+  free_voice_count = MAX_FMOD_PLAYING_SOUNDS;
+
+  for (int i = 0; i < MAX_FMOD_CHANNELS; i++)
+    free_channels[i] = MAX_FMOD_CHANNELS - 1 - i;
+
+  free_channel_count = MAX_FMOD_CHANNELS;
+}
+
+
+static void free_voice(int index)
+{
+  PlaySnd & s = playSnd[index];
+
+  if (!s.sound)
+    return;
+
+  released_channels.push(s.channel);
+  s.reset();
+  free_voices[free_voice_count++] = index;
+}
+
+
+// true if 'a' should be stolen before 'b': less important, then quieter, then older
+static bool steal_before(const PlaySnd & a, const PlaySnd & b)
+{
+  if (a.priority != b.priority)
+    return a.priority > b.priority;
+
+  float volumeA = a.volume * channel_volumes[a.channel];
+  float volumeB = b.volume * channel_volumes[b.channel];
+
+  if (volumeA != volumeB)
+    return volumeA < volumeB;
+
+  return int32_t(a.startSeq - b.startSeq) < 0;
+}
+
+
+// streams are never stolen, neither are voices more important than the new one
+static int find_victim(const PlaySnd & voice, bool same_group)
+{
+  int victim = -1;
+
+  for (int i = 0; i < MAX_FMOD_PLAYING_SOUNDS; i++)
+  {
+    const PlaySnd & s = playSnd[i];
+
+    if (!s.sound || s.stream || s.priority < voice.priority || (same_group && s.group != voice.group))
+      continue;
+
+    if (victim < 0 || steal_before(s, playSnd[victim]))
+      victim = i;
+  }
+
+  return victim;
+}
+
+
+static void start_voice(const MixerCommand & cmd)
+{
+  AudioStats & stats = mmc_audio_stats();
+  const PlaySnd & voice = cmd.voice;
+
+  // a stream has a single decoder, a new play only moves its voice to the new channel
+  for (PlaySnd & s : playSnd)
+    if (s.sound == cmd.sound && s.stream)
+    {
+      released_channels.push(s.channel);
+      s.channel = cmd.channel;
+      return;
+    }
+
+  if (voice.group && voice.maxAudible >= 0)
+  {
+    int audible = 0;
+
+    for (const PlaySnd & s : playSnd)
+      if (s.sound && s.group == voice.group)
+        audible++;
+
+    if (audible >= voice.maxAudible)
+    {
+      int victim = voice.behavior == FMOD_SOUNDGROUP_BEHAVIOR_STEALLOWEST ? find_victim(voice, true) : -1;
+
+      if (victim < 0)
+      {
+        stats.droppedPlays.fetch_add(1, std::memory_order_relaxed);
+        released_channels.push(cmd.channel);
+        return;
+      }
+
+      free_voice(victim);
+      stats.stolenVoices.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  if (!free_voice_count)
+  {
+    int victim = find_victim(voice, false);
+
+    if (victim < 0)
+    {
+      stats.droppedPlays.fetch_add(1, std::memory_order_relaxed);
+      released_channels.push(cmd.channel);
+      return;
+    }
+
+    free_voice(victim);
+    stats.stolenVoices.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (voice.startClock && voice.startClock < dsp_clock)
+    stats.lateStarts.fetch_add(1, std::memory_order_relaxed);
+
+  PlaySnd & s = playSnd[free_voices[--free_voice_count]];
+  s = voice;
+  s.startSeq = cmd.seq;
+}
+
+
+// called by the mixer, or by the game thread when the mixer is not running
+static void process_commands()
+{
+  MixerCommand cmd;
+
+  while (mixer_commands.pop(cmd))
+  {
+    switch (cmd.type)
+    {
+    case cmdPlay:
+      start_voice(cmd);
+      break;
+
+    case cmdStopSound:
+      for (int i = 0; i < MAX_FMOD_PLAYING_SOUNDS; i++)
+        if (playSnd[i].sound == cmd.sound)
+          free_voice(i);
+
+      break;
+
+    case cmdSetVolume:
+      channel_volumes[cmd.channel] = cmd.volume;
+      break;
+    }
+
+    processed_seq.store(cmd.seq, std::memory_order_release);
+  }
+}
+
+
+static uint32_t post_command(MixerCommand & cmd)
+{
+  cmd.seq = posted_seq + 1;
+
+  if (!mixer_commands.push(cmd))
+  {
+    printf("ERROR: mixer command queue overflow\n");
+    mmc_audio_stats().queueOverflows.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+  }
+
+  posted_seq = cmd.seq;
+
+  if (!is_mixer_running())
+    process_commands();
+
+  return cmd.seq;
+}
+
+
+static void publish_dsp_clock()
+{
+  anchor_seq.fetch_add(1);
+  anchor_clock.store(dsp_clock);
+  anchor_usec.store(get_monotonic_usec());
+  anchor_seq.fetch_add(1);
+}
+
+
+// the mixer clock advances in bursts of one buffer, between them it is extrapolated
+static uint64_t get_current_dsp_clock()
+{
+  uint32_t seq = 0;
+  uint64_t clock = 0;
+  uint64_t usec = 0;
+
+  do
+  {
+    seq = anchor_seq.load();
+    clock = anchor_clock.load();
+    usec = anchor_usec.load();
+  }
+  while ((seq & 1) || seq != anchor_seq.load());
+
+  if (!usec || !is_mixer_running())
+    return clock;
+
+  return clock + (get_monotonic_usec() - usec) * MMC_FREQ / 1000000;
+}
+
+
+// O(1), channels of finished voices are collected only when the pool looks empty
+static FMOD::Channel * alloc_channel()
+{
+  int index = 0;
+
+  if (!free_channel_count)
+    while (released_channels.pop(index))
+      free_channels[free_channel_count++] = index;
+
+  if (!free_channel_count)
+    return NULL;
+
+  FMOD::Channel * channel = &fmod_channels[free_channels[--free_channel_count]];
+  channel->volume = 1.0f;
+  return channel;
+}
+
+
+static void wait_for_mixer(uint32_t seq)
+{
+  while (processed_seq.load(std::memory_order_acquire) < seq)
+  {
+    if (!is_mixer_running())
+    {
+      process_commands();
+      break;
+    }
+
+    sleep_msec(1);
+  }
+}
 
 
 namespace FMOD
 {
+  // posts the voice to the mixer, a non-zero 'startClock' delays its first frame
+  static FMOD_RESULT start_sound(Sound * sound, Channel * playChannel, uint64_t startClock)
+  {
+    if (sound->length <= 2)
+    {
+      free_channels[free_channel_count++] = int(playChannel - fmod_channels);
+      return FMOD_OK;
+    }
+
+    // a stream has a single decoder, so it is played at most once at a time;
+    // while it is playing the mixer only moves its voice to the new channel
+    if (sound->stream && (!sound->lastPlaySeq || sound->stream->isFinished()))
+    {
+      if (sound->lastPlaySeq)
+      {
+        MixerCommand cmd;
+        memset(&cmd, 0, sizeof(cmd));
+        cmd.type = cmdStopSound;
+        cmd.sound = sound;
+        wait_for_mixer(post_command(cmd));
+      }
+
+      if (!sound->stream->start(sound->loopBeginSample))
+      {
+        free_channels[free_channel_count++] = int(playChannel - fmod_channels);
+        return FMOD_ERR;
+      }
+    }
+
+    MixerCommand cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = cmdPlay;
+    cmd.sound = sound;
+    cmd.channel = int(playChannel - fmod_channels);
+
+    PlaySnd & s = cmd.voice;
+    s.sound = sound;
+    s.stream = sound->stream;
+    s.channel = cmd.channel;
+    s.volume = 1.0f;
+    s.priority = sound->priority;
+    s.group = sound->soundGroup;
+    s.maxAudible = s.group ? s.group->maxAudible : -1;
+    s.behavior = s.group ? s.group->behavior : FMOD_SOUNDGROUP_BEHAVIOR_FAIL;
+    s.startClock = startClock;
+    s.playing = true;
+
+    bool loop = !!(sound->flags & FMOD_LOOP_NORMAL);
+    s.mix.data = sound->data;
+    s.mix.step = uint64_t(double(sound->advance) * MIX_FIXED_ONE + 0.5);
+    s.mix.pos = uint64_t(sound->loopBeginSample) << 32;
+    s.mix.begin = loop ? uint64_t(sound->loopBeginSample) << 32 : 0;
+    s.mix.end = uint64_t(loop ? sound->loopEndSample : sound->length) << 32;
+    s.mix.loop = loop;
+    s.mix.playing = true;
+
+    uint32_t seq = post_command(cmd);
+
+    if (!seq)
+    {
+      free_channels[free_channel_count++] = cmd.channel;
+      return FMOD_ERR;
+    }
+
+    sound->lastPlaySeq = seq;
+
+    return FMOD_OK;
+  }
+
 
   FMOD_RESULT Sound::setLoopPoints(int loopBegin, int loopBeginUnits, int loopEnd, int loopEndUnits)
   {
@@ -66,257 +446,643 @@ namespace FMOD
     loopBeginSample = loopBegin;
     loopEndSample = loopEnd;
 
+    if (stream)
+      stream->setLoop(!!(flags & FMOD_LOOP_NORMAL), loopBeginSample, loopEndSample);
+
     return FMOD_OK;
   }
 
 
   FMOD_RESULT Sound::release()
   {
-    ScopedLocker lock(cs);
-    // TODO: stop at playSnd
-    delete[] data;
+    if (lastPlaySeq)
+    {
+      MixerCommand cmd;
+      memset(&cmd, 0, sizeof(cmd));
+      cmd.type = cmdStopSound;
+      cmd.sound = this;
+      wait_for_mixer(post_command(cmd));
+      lastPlaySeq = 0;
+    }
+
+    if (ownData)
+      delete[] data;
+
+    pcm_cache_unmap(&cacheMapping);
+    delete stream;
+    stream = nullptr;
+
     data = nullptr;
+    length = 0;
+    return FMOD_OK;
+  }
+
+
+  FMOD_RESULT Sound::getDefaults(float * frequency, int * priority_)
+  {
+    if (frequency)
+      *frequency = float(MMC_FREQ) * advance;
+
+    if (priority_)
+      *priority_ = priority;
+
+    return FMOD_OK;
+  }
+
+
+  FMOD_RESULT Sound::setDefaults(float, int priority_)
+  {
+    if (priority_ < 0 || priority_ > 256)
+      return FMOD_ERR;
+
+    priority = priority_;
+    return FMOD_OK;
+  }
+
+
+  FMOD_RESULT Channel::setPaused(bool paused)
+  {
+    // a started voice cannot be paused
+    if (paused)
+      return pausedSound ? FMOD_OK : FMOD_ERR;
+
+    if (!pausedSound)
+      return FMOD_OK;
+
+    Sound * sound = pausedSound;
+    pausedSound = NULL;
+    return start_sound(sound, this, delayClock);
+  }
+
+
+  FMOD_RESULT Channel::getDSPClock(unsigned long long * dspclock, unsigned long long * parentclock)
+  {
+    uint64_t clock = get_current_dsp_clock();
+
+    if (dspclock)
+      *dspclock = clock;
+
+    if (parentclock)
+      *parentclock = clock;
+
+    return FMOD_OK;
+  }
+
+
+  FMOD_RESULT Channel::setDelay(unsigned long long dspclock_start, unsigned long long, bool)
+  {
+    if (!pausedSound)
+      return FMOD_ERR;
+
+    delayClock = dspclock_start;
     return FMOD_OK;
   }
 
 
+  FMOD_RESULT Channel::setVolume(float volume_)
+  {
+    volume = volume_;
+
+    MixerCommand cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = cmdSetVolume;
+    cmd.channel = int(this - fmod_channels);
+    cmd.volume = volume;
+
+    return post_command(cmd) ? FMOD_OK : FMOD_ERR;
+  }
+
+
   class PlayCallback: public IPcmPlayCallback
   {
-  public:
-    virtual void onAudioPlay(float * data, int frames_count, const BufferSettings * buffer_settings)
+    static const int MIX_CHUNK_FRAMES = 512;
+    float mix_acc[MIX_CHUNK_FRAMES * 2]; // stereo
+
+    void mixStream(PlaySnd & s, float * data, int frames_count, float volume)
     {
-      memset(data, 0, frames_count * buffer_settings->channels * sizeof(float));
-      ScopedLocker lock(cs);
+      const int chunk_size = 256;
+      float chunk[chunk_size * 2];
+
+      for (int d = 0; d < frames_count; d += chunk_size)
+      {
+        int count = frames_count - d < chunk_size ? frames_count - d : chunk_size;
+        int read = s.stream->read(chunk, count);
+
+        for (int i = 0; i < read * 2; i++)
+          data[d * 2 + i] += chunk[i] * volume;
+
+        if (read < count)
+        {
+          // underrun leaves a gap, end of stream stops the voice
+          if (s.stream->isFinished())
+            s.playing = false;
+
+          break;
+        }
+      }
+    }
+
+    // mixes the next 'count' frames into mix_acc
+    void mixChunk(int count)
+    {
+      MixVoice * voices[MAX_FMOD_PLAYING_SOUNDS];
+      int voice_count = 0;
+      const uint64_t chunk_end = dsp_clock + count;
+      memset(mix_acc, 0, count * 2 * sizeof(float));
 
       for (PlaySnd & s : playSnd)
         if (s.playing)
         {
-          float volume = s.volume;
-          if (s.originChannel)
-            volume *= s.originChannel->volume;
-          double pos = s.playPos;
-          const float * buf = s.data;
+          // a scheduled voice starts at its own frame inside the chunk
+          int offset = 0;
 
-          for (int d = 0; d < frames_count; d++)
+          if (s.startClock)
           {
-            int ipos = int(pos);
-            float t = pos - ipos;
-            float value0 = buf[ipos];
-            float value1 = buf[ipos + 1];
-            float value = value0 + (value1 - value0) * t;
-            data[d] += value * volume;
-            pos += s.advance;
-            if (pos >= s.endSample)
-            {
-              if (s.loop)
-                pos = s.beginSample;
-              else
-              {
-                s.playing = false;
-                break;
-              }
-            }
+            if (s.startClock >= chunk_end)
+              continue;
+
+            if (s.startClock > dsp_clock)
+              offset = int(s.startClock - dsp_clock);
+
+            s.startClock = 0;
           }
 
-          s.playPos = pos;
+          float volume = s.volume * channel_volumes[s.channel];
+
+          if (s.stream)
+            mixStream(s, mix_acc + offset * 2, count - offset, volume);
+          else if (offset)
+          {
+            MixVoice * voice = &s.mix;
+            s.mix.volume = volume;
+            mix_voices(mix_acc + offset * 2, count - offset, &voice, 1);
+          }
+          else
+          {
+            s.mix.volume = volume;
+            voices[voice_count++] = &s.mix;
+          }
         }
 
-      for (int i = 0; i < frames_count; i++)
+      mix_voices(mix_acc, count, voices, voice_count);
+      dsp_clock = chunk_end;
+
+      for (int i = 0; i < MAX_FMOD_PLAYING_SOUNDS; i++)
+        if (playSnd[i].playing && !playSnd[i].stream && !playSnd[i].mix.playing)
+          playSnd[i].playing = false;
+
+      for (int i = 0; i < MAX_FMOD_PLAYING_SOUNDS; i++)
+        if (playSnd[i].sound && !playSnd[i].playing)
+          free_voice(i);
+    }
+
+    void updateStats(uint64_t start_usec, int frames_count, const BufferSettings * buffer_settings)
+    {
+      AudioStats & stats = mmc_audio_stats();
+      uint32_t usec = uint32_t(get_monotonic_usec() - start_usec);
+      int voices = 0;
+
+      for (const PlaySnd & s : playSnd)
+        if (s.playing)
+          voices++;
+
+      stats.callbacks.fetch_add(1, std::memory_order_relaxed);
+      stats.renderedFrames.fetch_add(frames_count, std::memory_order_relaxed);
+      stats.callbackUsec.add(usec);
+      stats.activeVoices.add(voices);
+
+      if (frames_count > 0 && buffer_settings->freq > 0)
+        stats.loadPercent.add(uint32_t(usec * 1e-4 * buffer_settings->freq / frames_count));
+    }
+
+  public:
+    virtual void onAudioPlay(float * data, int frames_count, const BufferSettings * buffer_settings)
+    {
+      uint64_t start_usec = get_monotonic_usec();
+      const int channels = buffer_settings->channels;
+      publish_dsp_clock();
+      process_commands();
+
+      for (int offset = 0; offset < frames_count; offset += MIX_CHUNK_FRAMES)
       {
-        if (data[i] < -1.0f)
-          data[i] = -1.0f;
-        else if (data[i] > 1.0f)
-          data[i] = 1.0f;
+        int count = frames_count - offset < MIX_CHUNK_FRAMES ? frames_count - offset : MIX_CHUNK_FRAMES;
+        mixChunk(count);
+        mix_output(data + offset * channels, mix_acc, count, channels);
       }
 
-      if (buffer_settings->channels == 2)
-        for (int i = frames_count - 1; i >= 0; i--)
-        {
-          data[i * 2] = data[i];
-          data[i * 2 + 1] = data[i];
-        }
+      updateStats(start_usec, frames_count, buffer_settings);
+    }
 
-      if (buffer_settings->channels == 4)
-        for (int i = frames_count - 1; i >= 0; i--)
+    // the final pass converts straight into the device buffer
+    virtual bool onAudioPlayFormat(void * data, MmcSampleFormat format, int frames_count,
+                                   const BufferSettings * buffer_settings)
+    {
+      if (format == MMC_SAMPLE_FLOAT)
+      {
+        onAudioPlay((float *)data, frames_count, buffer_settings);
+        return true;
+      }
+
+      if (format != MMC_SAMPLE_S16 && format != MMC_SAMPLE_S24_3 && format != MMC_SAMPLE_S32)
+        return false;
+
+      uint64_t start_usec = get_monotonic_usec();
+      const int channels = buffer_settings->channels;
+      publish_dsp_clock();
+      process_commands();
+
+      for (int offset = 0; offset < frames_count; offset += MIX_CHUNK_FRAMES)
+      {
+        int count = frames_count - offset < MIX_CHUNK_FRAMES ? frames_count - offset : MIX_CHUNK_FRAMES;
+        int first = offset * channels;
+        mixChunk(count);
+
+        switch (format)
         {
-          data[i * 2] = data[i];
-          data[i * 2 + 1] = data[i];
-          data[i * 2 + 2] = data[i];
-          data[i * 2 + 3] = data[i];
+        case MMC_SAMPLE_S16:
+          mix_output_s16((int16_t *)data + first, mix_acc, count, channels);
+          break;
+        case MMC_SAMPLE_S24_3:
+          mix_output_s24((uint8_t *)data + first * 3, mix_acc, count, channels);
+          break;
+        case MMC_SAMPLE_S32:
+          mix_output_s32((int32_t *)data + first, mix_acc, count, channels);
+          break;
+        default:
+          break;
         }
+      }
+
+      updateStats(start_usec, frames_count, buffer_settings);
+      return true;
     }
   } pcm_play_callback;
 
 
+  static void start_output()
+  {
+    output = mmc_output_create(&pcm_play_callback);
+    output_start_time = get_time_msec();
+    latency_reported = false;
+
+    if (output)
+    {
+      int period_frames = 0;
+      int periods = 0;
+      mmc_get_play_buffer(&period_frames, &periods);
+      printf("Audio output: %s, period %d x %d frames\n", output->getName(), periods, period_frames);
+    }
+  }
+
+
+  FMOD_RESULT System::setDSPBufferSize(int buffer_length, int num_buffers)
+  {
+    mmc_set_play_buffer(buffer_length, num_buffers);
+    return FMOD_OK;
+  }
+
+
+  FMOD_RESULT System::getDSPBufferSize(unsigned int * buffer_length, int * num_buffers)
+  {
+    int period_frames = 0;
+    int periods = 0;
+    mmc_get_play_buffer(&period_frames, &periods);
+
+    if (buffer_length)
+      *buffer_length = period_frames;
+
+    if (num_buffers)
+      *num_buffers = periods;
+
+    return FMOD_OK;
+  }
+
+
+  FMOD_RESULT System::getSoftwareFormat(int * sample_rate, void *, int * raw_speakers)
+  {
+    if (sample_rate)
+      *sample_rate = MMC_FREQ;
+
+    if (raw_speakers)
+      *raw_speakers = MMC_PLAY_CHANNELS;
+
+    return FMOD_OK;
+  }
+
+
   FMOD_RESULT System::init(int max_play_sounds, int, void *)
   {
+    if (system_initialized)
+      return FMOD_ERR;
+
+    system_initialized = true;
+    start_output();
+    restart_time = get_time_msec() + restart_delay;
     return FMOD_OK;
   }
 
 
-  FMOD_RESULT System::createSound( const char * file_name, int flags, void *, Sound ** sound)
+  // converts to mixer format: interleaved stereo at MMC_FREQ with one guard frame after the end
+  // for interpolation, so voices of loaded sounds are mixed without resampling
+  static FMOD_RESULT setSoundData(Sound & snd, const float * buf, size_t frames, int channels, int hz, 
+                                  const char * name)
   {
-    if (used_sounds >= MAX_FMOD_SOUNDS || !file_name)
+    std::vector<float> stereo;
+
+    if (!buf || frames < 2 || channels < 1 || 
+        !resample_to_stereo(buf, frames, channels, hz ? hz : 44100, MMC_FREQ, stereo) || stereo.size() < 4)
+    {
+      printf("ERROR: invalid sound data in '%s'\n", name);
       return FMOD_ERR;
+    }
+
+    snd.advance = 1.0f;
+    snd.length = int(stereo.size() / 2);
+    snd.data = new float[(snd.length + 1) * 2];
+    snd.ownData = true;
+
+    memcpy(snd.data, stereo.data(), sizeof(float) * stereo.size());
+    snd.data[snd.length * 2] = snd.data[snd.length * 2 - 2];
+    snd.data[snd.length * 2 + 1] = snd.data[snd.length * 2 - 1];
+
+    return FMOD_OK;
+  }
+
 
-    if (!(*sound))
+  static FMOD_RESULT loadMp3(Sound & snd, const uint8_t * mem, size_t memSize, const char * file_name)
+  {
+    mp3dec_t mp3d;
+    mp3dec_file_info_t info;
+    memset(&mp3d, 0, sizeof(mp3d));
+    memset(&info, 0, sizeof(info));
+    int res = 0;
+
+    if (mem)
+      mp3dec_load_buf(&mp3d, mem, memSize, &info, NULL, NULL);
+    else
+      res = mp3dec_load(&mp3d, file_name, &info, NULL, NULL);
+
+    if (res || !info.samples)
     {
-      *sound = &(fmod_sounds[used_sounds]);
-      used_sounds++;
+      printf("ERROR: cannot load .mp3-file '%s'\n", file_name);
+      free(info.buffer);
+      return FMOD_ERR;
+    }
 
-      Sound & snd = **sound;
-      snd.flags = flags;
+    FMOD_RESULT result = setSoundData(snd, info.buffer, info.channels ? info.samples / info.channels : 0, 
+                                      info.channels, info.hz, file_name);
+    free(info.buffer);
 
-      if (strstr(file_name, ".mp3"))
-      {
-        mp3dec_t mp3d;
-        mp3dec_file_info_t info;
-        memset(&mp3d, 0, sizeof(mp3d));
-        memset(&info, 0, sizeof(info));
-        int res = mp3dec_load(&mp3d, file_name, &info, NULL, NULL);
-        if (res)
-        {
-          printf("ERROR: cannot load .mp3-file '%s'\n", file_name);
-          free(info.buffer);
-          return FMOD_ERR;
-        }
+    return result;
+  }
 
-        snd.advance = float(info.hz ? info.hz : 44100) / MMC_FREQ;
 
-        if (info.channels == 1)
-        {
-          snd.length = info.samples;
-          snd.data = new float[snd.length + 1];
-          memcpy(snd.data, info.buffer, sizeof(float) * snd.length);
-          snd.data[snd.length] = snd.data[snd.length - 1];
-        }
-        else if (info.channels == 2)
-        {
-          snd.length = info.samples / 2;
-          snd.data = new float[snd.length + 1];
-          for (size_t i = 0; i < snd.length; i++)
-            snd.data[i] = (info.buffer[i * 2] + info.buffer[i * 2 + 1]) * 0.5f;
-          snd.data[snd.length] = snd.data[snd.length - 1];
-        }
-        else
-        {
-          printf("ERROR: invalid number of channels in '%s'\n", file_name);
-          free(info.buffer);
-          return FMOD_ERR;
-        }
+  static FMOD_RESULT loadWav(Sound & snd, const uint8_t * mem, size_t memSize, const char * file_name)
+  {
+    unsigned int channels = 1;
+    unsigned int sampleRate = 44100;
+    drwav_uint64 totalSampleCount = 0;
+    float * buf = mem ? drwav_open_and_read_memory_f32(mem, memSize, &channels, &sampleRate, &totalSampleCount) :
+                        drwav_open_and_read_file_f32(file_name, &channels, &sampleRate, &totalSampleCount);
 
-        free(info.buffer);
-      }
-      else if (strstr(file_name, ".wav"))
-      {
-        unsigned int channels = 1;
-        unsigned int sampleRate = 44100;
-        drwav_uint64 totalSampleCount = 0;
-        float * buf = drwav_open_and_read_file_f32(file_name, &channels, &sampleRate, &totalSampleCount);
+    if (!buf)
+    {
+      printf("ERROR: cannot load .wav-file '%s'\n", file_name);
+      return FMOD_ERR;
+    }
 
-        snd.advance = float(sampleRate) / MMC_FREQ;
+    FMOD_RESULT result = setSoundData(snd, buf, channels ? size_t(totalSampleCount / channels) : 0, 
+                                      channels, sampleRate, file_name);
+    drwav_free(buf);
 
-        if (channels == 1)
-        {
-          snd.length = totalSampleCount;
-          snd.data = new float[snd.length + 1];
-          memcpy(snd.data, buf, sizeof(float) * snd.length);
-          snd.data[snd.length] = snd.data[snd.length - 1];
-        }
-        else if (channels == 2)
-        {
-          snd.length = totalSampleCount / 2;
-          snd.data = new float[snd.length + 1];
-          for (size_t i = 0; i < snd.length; i++)
-            snd.data[i] = (buf[i * 2] + buf[i * 2 + 1]) * 0.5f;
-          snd.data[snd.length] = snd.data[snd.length - 1];
-        }
-        else
-        {
-          free(buf);
-          return FMOD_ERR;
-        }
-      }
-      else
-      {
-        printf("Invalid file type '%s', expected .wav, .mp3\n", file_name);
-        return FMOD_ERR;
-      }
+    return result;
+  }
 
+
+  static FMOD_RESULT loadRaw(Sound & snd, const char * mem, int flags, const FMOD_CREATESOUNDEXINFO * exinfo)
+  {
+    if (exinfo->format != FMOD_SOUND_FORMAT_PCMFLOAT || exinfo->numchannels <= 0)
+    {
+      printf("ERROR: unsupported raw sound format\n");
+      return FMOD_ERR;
+    }
+
+    const float * buf = (const float *)(mem + exinfo->fileoffset);
+    size_t frames = exinfo->length / (sizeof(float) * exinfo->numchannels);
+
+    // data already in mixer format is used in place, the last frame serves as the interpolation guard
+    if ((flags & FMOD_OPENMEMORY_POINT) && exinfo->numchannels == 2 && exinfo->defaultfrequency == MMC_FREQ && 
+        frames >= 2)
+    {
+      snd.advance = 1.0f;
+      snd.data = const_cast<float *>(buf);
+      snd.length = int(frames - 1);
+      snd.ownData = false;
       return FMOD_OK;
     }
 
+    return setSoundData(snd, buf, frames, exinfo->numchannels, exinfo->defaultfrequency, "raw data");
+  }
+
+
+  static FMOD_RESULT openStream(Sound & snd, const uint8_t * mem, size_t memSize, const char * file_name)
+  {
+    Mp3Stream * stream = new Mp3Stream;
+
+    if (mem ? !stream->open(mem, memSize) : !stream->openFile(file_name))
+    {
+      if (mem)
+        printf("ERROR: cannot open .mp3-stream from memory\n");
+
+      delete stream;
+      return FMOD_ERR;
+    }
+
+    snd.stream = stream;
+    snd.advance = float(stream->getHz()) / MMC_FREQ;
+    snd.length = stream->getLength();
+
     return FMOD_OK;
   }
 
 
-  FMOD_RESULT System::playSound(Sound *& sound, void *, bool, Channel ** channel)
+  static bool loadCached(Sound & snd, const PcmCacheKey & key)
+  {
+    int length = 0;
+    float advance = 0.0f;
+    const float * data = pcm_cache_load(key, &length, &advance, &snd.cacheMapping);
+
+    if (!data)
+      return false;
+
+    snd.data = const_cast<float *>(data);
+    snd.length = length;
+    snd.advance = advance;
+    snd.ownData = false;
+
+    return true;
+  }
+
+
+  FMOD_RESULT System::createSound(const char * name_or_data, int flags, FMOD_CREATESOUNDEXINFO * exinfo, 
+                                  Sound ** sound)
   {
-    if (used_channels >= MAX_FMOD_CHANNELS)
+    if (used_sounds >= MAX_FMOD_SOUNDS || !name_or_data)
       return FMOD_ERR;
 
-    if (!(*channel))
+    if (*sound)
+      return FMOD_OK;
+
+    bool fromMemory = !!(flags & (FMOD_OPENMEMORY | FMOD_OPENMEMORY_POINT));
+
+    if ((fromMemory || (flags & FMOD_OPENRAW)) && (!exinfo || exinfo->cbsize != sizeof(*exinfo)))
     {
-      *channel = &(fmod_channels[used_channels]);
-      used_channels++;
+      printf("ERROR: FMOD_CREATESOUNDEXINFO is required for memory and raw sounds\n");
+      return FMOD_ERR;
     }
 
-    if (sound->length <= 2)
-      return FMOD_OK;
+    Sound & snd = fmod_sounds[used_sounds];
+    snd.flags = flags;
+    snd.priority = 128;
+    FMOD_RESULT result = FMOD_ERR;
+
+    if (fromMemory && (flags & FMOD_OPENRAW))
+      result = loadRaw(snd, name_or_data, flags, exinfo);
+    else if ((flags & FMOD_CREATESTREAM) && (fromMemory || strstr(name_or_data, ".mp3")))
+      result = openStream(snd, fromMemory ? (const uint8_t *)name_or_data : NULL, 
+                          fromMemory ? exinfo->length : 0, name_or_data);
+    else
+    {
+      PcmCacheKey cacheKey;
+      bool cacheable = true;
 
-    ScopedLocker lock(cs);
+      if (fromMemory)
+        pcm_cache_key_for_memory(name_or_data, exinfo->length, &cacheKey);
+      else
+        cacheable = pcm_cache_key_for_file(name_or_data, &cacheKey);
 
-    for (PlaySnd & s : playSnd)
-      if (!s.playing)
+      if (cacheable && loadCached(snd, cacheKey))
+        result = FMOD_OK;
+      else
       {
-        s.originChannel = *channel;
-        s.data = sound->data;
-        s.advance = sound->advance;
-        s.playPos = sound->loopBeginSample;
-        s.volume = 1.0f;
-        s.playing = true;
-        s.loop = !!(sound->flags & FMOD_LOOP_NORMAL);
-        s.beginSample = s.loop ? sound->loopBeginSample : 0;
-        s.endSample = s.loop ? sound->loopEndSample : sound->length;
-
-        break;
+        const uint8_t * mem = (const uint8_t *)name_or_data;
+
+        if (fromMemory && exinfo->length >= 4 && !memcmp(mem, "RIFF", 4))
+          result = loadWav(snd, mem, exinfo->length, "memory");
+        else if (fromMemory)
+          result = loadMp3(snd, mem, exinfo->length, "memory");
+        else if (strstr(name_or_data, ".mp3"))
+          result = loadMp3(snd, NULL, 0, name_or_data);
+        else if (strstr(name_or_data, ".wav"))
+          result = loadWav(snd, NULL, 0, name_or_data);
+        else
+          printf("Invalid file type '%s', expected .wav, .mp3\n", name_or_data);
+
+        if (cacheable && result == FMOD_OK)
+          pcm_cache_store(cacheKey, snd.data, snd.length, snd.advance);
       }
+    }
+
+    if (result == FMOD_OK)
+    {
+      *sound = &snd;
+      used_sounds++;
+    }
+
+    return result;
+  }
+
+
+  FMOD_RESULT System::createSoundGroup(const char *, SoundGroup ** soundGroup)
+  {
+    if (used_sound_groups >= MAX_FMOD_SOUND_GROUPS)
+      return FMOD_ERR;
 
+    *soundGroup = &fmod_sound_groups[used_sound_groups++];
     return FMOD_OK;
   }
 
 
+  // every play gets a new channel, as in FMOD
+  FMOD_RESULT System::playSound(Sound *& sound, void *, bool paused, Channel ** channel)
+  {
+    Channel * playChannel = alloc_channel();
+
+    if (!playChannel)
+      return FMOD_ERR;
+
+    *channel = playChannel;
+    playChannel->pausedSound = NULL;
+    playChannel->delayClock = 0;
+    playChannel->setVolume(playChannel->volume);
+
+    if (paused)
+    {
+      playChannel->pausedSound = sound;
+      return FMOD_OK;
+    }
+
+    return start_sound(sound, playChannel, 0);
+  }
+
+
   FMOD_RESULT System::update()
   {
-    if (quited)
+    if (quited || !system_initialized)
       return FMOD_OK;
 
-    if (mmc_ex_need_restart())
+    if (output && !output->needRestart())
     {
-      static int restartCount = 10;
-      if (restartCount-- > 0)
+      if (!latency_reported && get_time_msec() - output_start_time > OUTPUT_LATENCY_REPORT_MSEC)
       {
-        mmc_ex_finlaize();
-        mmc_ex_init(NULL, &pcm_play_callback, NULL);
+        printf("Audio latency: %.1f ms\n", output->getLatency() * 1000.0);
+        latency_reported = true;
       }
+
+      return FMOD_OK;
     }
+
+    uint32_t time = get_time_msec();
+
+    if (int32_t(time - restart_time) < 0)
+      return FMOD_OK;
+
+    if (output)
+      mmc_audio_stats().restarts.fetch_add(1, std::memory_order_relaxed);
+
+    delete output;
+    // the mixer is stopped here, so the voices are safe to touch
+    process_commands();
+    start_output();
+
+    if (output)
+      restart_delay = OUTPUT_RESTART_DELAY_MIN_MSEC;
+    else
+      restart_delay = std::min(restart_delay * 2, (uint32_t)OUTPUT_RESTART_DELAY_MAX_MSEC);
+
+    restart_time = get_time_msec() + restart_delay;
     return FMOD_OK;
   }
 
 
   FMOD_RESULT System::release()
   {
-    ScopedLocker lock(cs);
+    delete output;
+    output = NULL;
     quited = true;
-    mmc_ex_finlaize();
+    // voices are not mixed anymore, apply pending commands here
+    process_commands();
+
+    if (getenv("MMC_AUDIO_STATS"))
+      mmc_audio_stats().print();
     return FMOD_OK;
   }
 
 
   FMOD_RESULT System_Create(void *)
   {
+    init_voices();
     mmc_setup_term_handlers();
-    mmc_ex_init(NULL, &pcm_play_callback, NULL);
     return FMOD_OK;
   }
 };
@@ -3,6 +3,9 @@
 #include <string.h>
 #include <memory.h>
 #include <vector>
+#include "pcm_cache.h"
+
+class Mp3Stream;
 
 typedef enum
 {
@@ -14,14 +17,65 @@ typedef enum
 #define FMOD_VERSION 1
 #define FMOD_INIT_NORMAL 1
 #define FMOD_DEFAULT 0
-#define FMOD_CREATESTREAM 0
+#define FMOD_CREATESTREAM 0x00000080
 #define FMOD_LOOP_NORMAL 1
 #define FMOD_TIMEUNIT_MS 2
+#define FMOD_OPENMEMORY 0x00000800
+#define FMOD_OPENRAW 0x00001000
+#define FMOD_OPENMEMORY_POINT 0x10000000
+
+typedef enum
+{
+  FMOD_SOUND_FORMAT_NONE,
+  FMOD_SOUND_FORMAT_PCM8,
+  FMOD_SOUND_FORMAT_PCM16,
+  FMOD_SOUND_FORMAT_PCM24,
+  FMOD_SOUND_FORMAT_PCM32,
+  FMOD_SOUND_FORMAT_PCMFLOAT,
+  FMOD_SOUND_FORMAT_FORCEINT = 65536
+} FMOD_SOUND_FORMAT;
+
+// subset of the FMOD structure, only fields used by FMOD_OPENMEMORY* and FMOD_OPENRAW
+typedef struct
+{
+  int cbsize;
+  unsigned int length;
+  unsigned int fileoffset;
+  int numchannels;
+  int defaultfrequency;
+  FMOD_SOUND_FORMAT format;
+} FMOD_CREATESOUNDEXINFO;
+
+typedef enum
+{
+  FMOD_SOUNDGROUP_BEHAVIOR_FAIL,
+  FMOD_SOUNDGROUP_BEHAVIOR_MUTE, // treated as FAIL, there are no virtual voices
+  FMOD_SOUNDGROUP_BEHAVIOR_STEALLOWEST,
+  FMOD_SOUNDGROUP_BEHAVIOR_FORCEINT = 65536
+} FMOD_SOUNDGROUP_BEHAVIOR;
 
 namespace FMOD
 {
   FMOD_RESULT System_Create(void *);
 
+  // limits the number of voices playing sounds of the group at once
+  class SoundGroup
+  {
+  public:
+    int maxAudible; // -1 = unlimited
+    FMOD_SOUNDGROUP_BEHAVIOR behavior;
+
+    SoundGroup()
+    {
+      maxAudible = -1;
+      behavior = FMOD_SOUNDGROUP_BEHAVIOR_FAIL;
+    }
+
+    FMOD_RESULT setMaxAudible(int maxAudible_) { maxAudible = maxAudible_; return FMOD_OK; }
+    FMOD_RESULT setMaxAudibleBehavior(FMOD_SOUNDGROUP_BEHAVIOR behavior_) { behavior = behavior_; return FMOD_OK; }
+    FMOD_RESULT release() { return FMOD_OK; }
+  };
+
   class Sound
   {
   public:
@@ -31,31 +85,45 @@ namespace FMOD
     int loopEndSample;
     int flags;
     float advance;
+    bool ownData;
+    PcmCacheMapping cacheMapping;
+    Mp3Stream * stream;
+    uint32_t lastPlaySeq;
+    int priority; // 0 (most important) .. 256, a voice is only stolen by sounds of the same or lower value
+    SoundGroup * soundGroup;
     Sound() { memset(this, 0, sizeof(*this)); }
     ~Sound() { release(); }
     FMOD_RESULT release();
     FMOD_RESULT setLoopPoints(int loopBegin, int loopBeginUnits, int loopEnd, int loopEndUnits);
+    FMOD_RESULT getDefaults(float * frequency, int * priority_);
+    FMOD_RESULT setDefaults(float frequency, int priority_); // frequency is ignored
+    FMOD_RESULT setSoundGroup(SoundGroup * soundGroup_) { soundGroup = soundGroup_; return FMOD_OK; }
   };
 
+  // A channel is the handle of one playing voice, like in FMOD. It returns to the pool
+  // when the voice ends, later calls through an old handle may affect a newer voice.
+  // A sound played paused starts on setPaused(false), at the DSP clock given by setDelay.
   class Channel
   {
   public:
     float volume;
-    bool volumeChanged;
+    Sound * pausedSound;
+    unsigned long long delayClock;
 
     Channel()
     {
       volume = 1.0f;
-      volumeChanged = true;
-    }
-
-    FMOD_RESULT setVolume(float volume_)
-    {
-      volume = volume_;
-      volumeChanged = true;
-      return FMOD_OK;
+      pausedSound = NULL;
+      delayClock = 0;
     }
 
+    FMOD_RESULT setVolume(float volume_);
+    FMOD_RESULT setPaused(bool paused);
+    // both clocks are the mixer clock in output frames, extrapolated to the current time
+    FMOD_RESULT getDSPClock(unsigned long long * dspclock, unsigned long long * parentclock);
+    // only before a paused channel is started; the end clock is not supported
+    FMOD_RESULT setDelay(unsigned long long dspclock_start, unsigned long long dspclock_end, 
+                         bool stopchannels = true);
     FMOD_RESULT release() { return FMOD_OK; }
   };
 
@@ -65,8 +133,12 @@ namespace FMOD
   public:
     FMOD_RESULT getVersion(unsigned int * version) { *version = FMOD_VERSION; return FMOD_OK; }
     FMOD_RESULT init(int max_play_sounds, int, void *);
-    FMOD_RESULT setDSPBufferSize(int, int) { return FMOD_OK; };
-    FMOD_RESULT createSound( const char * file_name, int flags, void *, Sound ** sound);
+    FMOD_RESULT setDSPBufferSize(int buffer_length, int num_buffers);
+    FMOD_RESULT getDSPBufferSize(unsigned int * buffer_length, int * num_buffers);
+    FMOD_RESULT getSoftwareFormat(int * sample_rate, void * speaker_mode, int * raw_speakers);
+    FMOD_RESULT createSound(const char * name_or_data, int flags, FMOD_CREATESOUNDEXINFO * exinfo, 
+                            Sound ** sound);
+    FMOD_RESULT createSoundGroup(const char * name, SoundGroup ** soundGroup);
     FMOD_RESULT playSound(Sound *& sound, void *, bool, Channel ** channel);
     FMOD_RESULT update();
     FMOD_RESULT release();
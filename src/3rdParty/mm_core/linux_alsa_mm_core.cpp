@@ -9,7 +9,9 @@
 #include <signal.h>
 #include <sys/poll.h>
 #include <sys/time.h>
+#include <atomic>
 #include "pthread_sys_lock.h"
+#include "audio_stats.h"
 
 
 
@@ -18,6 +20,9 @@
 #define MIDI_CLIENT_NAME "mm_core_alsa_midi"
 #define MAX_MIDI_POLL_DESC 16
 #define MAX_MIDI_MESSAGES 1000
+// this many playback xruns within the window make the output restart with a doubled period
+#define XRUN_FALLBACK_COUNT 3
+#define XRUN_FALLBACK_WINDOW_MSEC 5000
 
 #define MIDI_FATAL(...) \
   do \
@@ -88,7 +93,13 @@ class AlsaWrapper
   float * playBuffer;
   int playFrames;
   int maxPlayFrames;
+  int playPeriods;
+  bool playMmap; // SND_PCM_ACCESS_MMAP_INTERLEAVED, rendered straight into the device buffer
   BufferSettings playBufferSettings;
+  std::atomic<int> playDelay; // frames, measured after every write
+  uint32_t xrunWindowStart;
+  int xrunWindowCount;
+  bool xrunFallbackRequested; // play thread only, the thread stops and then sets playXrunFallback
 
   bool midiThreadCreated;
   pthread_t midiThread;
@@ -112,7 +123,7 @@ class AlsaWrapper
     ThreadExitGuard(AlsaWrapper * wrap_) : wrap(wrap_) {}
     ~ThreadExitGuard()
     {
-      if (!wrap->exiting)
+      if (!wrap->exiting && !wrap->playXrunFallback)
       {
         wrap->unplannedThreadExit = true;
         printf("\n*** Unplanned exit from thread ***\n");
@@ -144,6 +155,18 @@ class AlsaWrapper
     };
   }
 
+  static MmcSampleFormat format_to_sample_format(int pcm_fromat)
+  {
+    switch (pcm_fromat)
+    {
+      case PCMF_S16: return MMC_SAMPLE_S16;
+      case PCMF_S24: return MMC_SAMPLE_S24_3;
+      case PCMF_FLOAT: return MMC_SAMPLE_FLOAT;
+      case PCMF_S32: return MMC_SAMPLE_S32;
+      default: return MMC_SAMPLE_FLOAT;
+    };
+  }
+
   static int format_stride(int pcm_fromat)
   {
     switch (pcm_fromat)
@@ -296,6 +319,7 @@ class AlsaWrapper
 
 public:
   volatile bool unplannedThreadExit;
+  std::atomic<bool> playXrunFallback; // too many xruns, restart with a longer period
   bool inited;
 
   AlsaWrapper()
@@ -319,6 +343,13 @@ public:
 
     maxPlayFrames = 4096;
     playFrames = maxPlayFrames;
+    playPeriods = MMC_PLAY_BUFFERS;
+    playMmap = false;
+    playDelay = 0;
+    xrunWindowStart = 0;
+    xrunWindowCount = 0;
+    xrunFallbackRequested = false;
+    playXrunFallback = false;
     playback_handle = NULL;
     playBufferSys = NULL;
     playBuffer = NULL;
@@ -410,6 +441,7 @@ public:
     int desiredPlayChannels,
     int desiredRecordBufferFrames,
     int desiredPlayBufferFrames,
+    int desiredPlayPeriods,
     IPcmRecordCallback *pcmRecordCallback_,
     IPcmPlayCallback *pcmPlayCallback_,
     IMidiCallback *midiCallback_,
@@ -535,6 +567,7 @@ public:
 
       int err = 0;
       playFrames = desiredPlayBufferFrames;
+      playPeriods = desiredPlayPeriods;
       unsigned int rate = desiredFrequency;
       int dir = 0;
       //snd_pcm_format_t format = SND_PCM_FORMAT_S16_LE;
@@ -559,12 +592,21 @@ public:
         return false;
       }
 
-      if ((err = snd_pcm_hw_params_set_access(playback_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0)
+      // mmap access saves two buffer copies per period, MMC_ALSA_MMAP=0 disables it
+      const char * mmapEnv = getenv("MMC_ALSA_MMAP");
+      playMmap = !mmapEnv || strcmp(mmapEnv, "0") != 0;
+
+      if (playMmap && snd_pcm_hw_params_set_access(playback_handle, hw_params, SND_PCM_ACCESS_MMAP_INTERLEAVED) < 0)
+        playMmap = false;
+
+      if (!playMmap && (err = snd_pcm_hw_params_set_access(playback_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED)) < 0)
       {
         printf("ERROR: cannot set access type (%s)\n", snd_strerror(err));
         return false;
       }
 
+      printf("  access: %s\n", playMmap ? "mmap" : "read/write");
+
       for (int f = PCMF_UNKNOWN + 1; f < PCMF__COUNT; f++)
       {
         snd_pcm_format_t format = format_to_alsa_format(f); 
@@ -599,7 +641,7 @@ public:
 
 
 
-      int nperiods = MMC_PLAY_BUFFERS;
+      int nperiods = playPeriods;
       int period = desiredPlayBufferFrames;
       snd_pcm_uframes_t real_buffer_size = 0;
       snd_pcm_uframes_t real_period_size = 0;
@@ -645,6 +687,12 @@ public:
         printf( "WARNING: period size does not match: (requested %i, got %i)\n", period, (int)real_period_size );
       }
 
+      if (real_period_size > 0 && int(real_period_size) < maxPlayFrames)
+        playFrames = int(real_period_size);
+
+      printf("  period: %d frames, buffer: %d frames (%.1f ms)\n", playFrames, (int)real_buffer_size,
+             1000.0 * real_buffer_size / rate);
+
 
 
       if ((err = snd_pcm_hw_params(playback_handle, hw_params)) < 0)
@@ -955,6 +1003,113 @@ public:
     return err;
   }
 
+  void onPlayXrun()
+  {
+    mmc_audio_stats().xruns.fetch_add(1, std::memory_order_relaxed);
+    uint32_t time = get_time_msec();
+
+    if (time - xrunWindowStart > XRUN_FALLBACK_WINDOW_MSEC)
+    {
+      xrunWindowStart = time;
+      xrunWindowCount = 0;
+    }
+
+    if (++xrunWindowCount >= XRUN_FALLBACK_COUNT && playFrames * 2 <= maxPlayFrames)
+      xrunFallbackRequested = true;
+  }
+
+  void updatePlayDelay()
+  {
+    snd_pcm_sframes_t delay = 0;
+
+    if (snd_pcm_delay(playback_handle, &delay) == 0)
+      playDelay.store(int(delay), std::memory_order_relaxed);
+  }
+
+  double getPlayLatency() const
+  {
+    return playBufferSettings.freq > 0 ? double(playDelay.load(std::memory_order_relaxed)) / playBufferSettings.freq : 0.0;
+  }
+
+  int getPlayFrames() const
+  {
+    return playFrames;
+  }
+
+  // interleaved samples in device format, converted from float when the callback cannot do it
+  void renderPlay(void * dst, int frames)
+  {
+    if (pcmPlayCallback->onAudioPlayFormat(dst, format_to_sample_format(sysPlayFormat), frames, &playBufferSettings))
+      return;
+
+    pcmPlayCallback->onAudioPlay(playBuffer, frames, &playBufferSettings);
+    convert_float_to_fmt_buf(sysPlayFormat, playBuffer, dst, frames * playBufferSettings.channels);
+  }
+
+  // mmap access: fills up to one period directly in the device ring buffer
+  bool playMmapPeriod(bool & written)
+  {
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(playback_handle);
+    int err = 0;
+
+    if (avail < 0)
+    {
+      printf("ERROR:[p] an xrun occured (%s)\n", snd_strerror(int(avail)));
+      onPlayXrun();
+      if ((err = snd_pcm_recover(playback_handle, int(avail), 0)) < 0)
+        printf("ERROR:[p] playback recover failed (%s)\n", snd_strerror(err));
+      return err >= 0;
+    }
+
+    if (avail < playFrames && written)
+    {
+      if ((err = snd_pcm_wait(playback_handle, 6000)) < 0) // wait for 6 sec
+      {
+        printf("ERROR:[p] poll failed (%s)\n", snd_strerror(err));
+        snd_pcm_recover(playback_handle, err, 0);
+        return false;
+      }
+      return true;
+    }
+
+    snd_pcm_uframes_t frames = avail > playFrames ? playFrames : avail;
+
+    while (frames > 0)
+    {
+      const snd_pcm_channel_area_t * areas = NULL;
+      snd_pcm_uframes_t offset = 0;
+      snd_pcm_uframes_t count = frames;
+
+      if ((err = snd_pcm_mmap_begin(playback_handle, &areas, &offset, &count)) < 0)
+      {
+        printf("ERROR:[p] snd_pcm_mmap_begin failed (%s)\n", snd_strerror(err));
+        snd_pcm_recover(playback_handle, err, 0);
+        return false;
+      }
+
+      // interleaved access: all channels share one area, frames are contiguous
+      char * dst = (char *)areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+      renderPlay(dst, int(count));
+
+      snd_pcm_sframes_t committed = snd_pcm_mmap_commit(playback_handle, offset, count);
+
+      if (committed < 0 || snd_pcm_uframes_t(committed) != count)
+      {
+        err = committed < 0 ? int(committed) : -EPIPE;
+        printf("ERROR:[p] snd_pcm_mmap_commit failed (%s)\n", snd_strerror(err));
+        onPlayXrun();
+        snd_pcm_recover(playback_handle, err, 0);
+        return false;
+      }
+
+      frames -= count;
+      written = true;
+    }
+
+    updatePlayDelay();
+    return true;
+  }
+
   static void * playThreadFunc(void * ptr)
   {
     int fails = 0;
@@ -962,7 +1117,7 @@ public:
     bool written = false;
     AlsaWrapper * wrap = (AlsaWrapper *)ptr;
     ThreadExitGuard guard(wrap);
-    while (!wrap->exiting)
+    while (!wrap->exiting && !wrap->xrunFallbackRequested)
     {
       cnt++;
       if ((cnt & 0xff) == 0 && fails > 0)
@@ -981,6 +1136,7 @@ public:
 
       if (state == SND_PCM_STATE_XRUN)
       {
+        wrap->onPlayXrun();
         if ((err = outstream_xrun_recovery(wrap->playback_handle, -EPIPE)) < 0)
           printf("ERROR:[p] SND_PCM_STATE_SETUP: outstream_xrun_recovery failed (1)\n");
         continue;
@@ -993,6 +1149,25 @@ public:
         continue;
       }
 
+      if (wrap->playMmap)
+      {
+        // prepared stream is filled first, commit starts it
+        if (!wrap->playMmapPeriod(written))
+        {
+          fails++;
+          if (fails > 10)
+            break;
+        }
+
+        if (snd_pcm_state(wrap->playback_handle) == SND_PCM_STATE_PREPARED && written &&
+            (err = snd_pcm_start(wrap->playback_handle)) < 0)
+        {
+          printf("ERROR:[p] snd_pcm_start error (%s)\n", snd_strerror(err));
+          break;
+        }
+        continue;
+      }
+
       if (state == SND_PCM_STATE_PREPARED)
       {
         if ((err = snd_pcm_start(wrap->playback_handle)) < 0)
@@ -1008,6 +1183,7 @@ public:
       {
         if (err == -EPIPE)
         {
+          wrap->onPlayXrun();
 	        err = snd_pcm_prepare(wrap->playback_handle);
 	        if (err < 0)
           {
@@ -1024,7 +1200,10 @@ public:
       if ((frames_to_deliver = snd_pcm_avail_update(wrap->playback_handle)) < 0)
       {
         if (frames_to_deliver == -EPIPE)
+        {
           printf("ERROR:[p] an xrun occured\n");
+          wrap->onPlayXrun();
+        }
         else
           printf("ERROR:[p] unknown ALSA avail update return value (%d)\n", frames_to_deliver);
 
@@ -1044,10 +1223,7 @@ public:
       if (wrap->pcmPlayCallback && frames_to_deliver > 0)
       {
         //ScopedLocker lock(wrap->playLock);
-        wrap->pcmPlayCallback->onAudioPlay(wrap->playBuffer, frames_to_deliver, &wrap->playBufferSettings);
-
-        unsigned int cnt = frames_to_deliver * wrap->playBufferSettings.channels;
-        convert_float_to_fmt_buf(wrap->sysPlayFormat, wrap->playBuffer, wrap->playBufferSys, cnt);
+        wrap->renderPlay(wrap->playBufferSys, frames_to_deliver);
 
         if ((err = snd_pcm_writei(wrap->playback_handle, wrap->playBufferSys, frames_to_deliver)) < 0)
         {
@@ -1062,11 +1238,17 @@ public:
         else
         {
           written = true;
+          wrap->updatePlayDelay();
         }
 
       }
     }
 
+    // reported only now: once needRestart() is true the game thread processes mixer commands
+    // itself, so the callback must not run any more
+    if (wrap->xrunFallbackRequested)
+      wrap->playXrunFallback = true;
+
     return NULL;
   }
 
@@ -1292,6 +1474,7 @@ void mmc_run_main_loop(
         MMC_PLAY_CHANNELS, // play
         MMC_BUF_SIZE, // rec
         MMC_BUF_SIZE, // play
+        MMC_PLAY_BUFFERS,
         pcm_record_callback,
         pcm_play_callback,
         midi_callback,
@@ -1384,6 +1567,10 @@ bool mmc_ex_init(
     if (!*playDevice)
       playDevice = "default";
 
+    int playPeriodFrames = MMC_BUF_SIZE;
+    int playPeriods = MMC_PLAY_BUFFERS;
+    mmc_get_play_buffer(&playPeriodFrames, &playPeriods);
+
     bool res = wrap->init(
       recordDevice, // rec
       playDevice, // play
@@ -1392,7 +1579,8 @@ bool mmc_ex_init(
       MMC_REC_CHANNELS, // rec
       MMC_PLAY_CHANNELS, // play
       MMC_BUF_SIZE, // rec
-      MMC_BUF_SIZE, // play
+      playPeriodFrames, // play
+      playPeriods,
       pcm_record_callback,
       pcm_play_callback,
       midi_callback,
@@ -1413,11 +1601,23 @@ bool mmc_ex_init(
 
 bool mmc_ex_need_restart()
 {
-  return wrap && wrap->unplannedThreadExit;
+  return wrap && (wrap->unplannedThreadExit || wrap->playXrunFallback);
+}
+
+double mmc_ex_get_play_latency()
+{
+  return wrap ? wrap->getPlayLatency() : 0.0;
 }
 
 void mmc_ex_finlaize()
 {
+  if (wrap && wrap->playXrunFallback)
+  {
+    int period = wrap->getPlayFrames() * 2;
+    printf("WARNING: playback xruns, period increased to %d frames\n", period);
+    mmc_set_min_play_period(period);
+  }
+
   delete wrap;
   wrap = NULL;
 }
@@ -0,0 +1,559 @@
+#include "mix_kernel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define MIX_X86 1
+#endif
+
+// voices summed per pass over the accumulator
+#define MIX_GROUP 4
+// voices handled by one mix_voices() batch
+#define MIX_BATCH 64
+
+typedef void (*MixAddFunc)(float * acc, const float * src, int count, float volume);
+typedef void (*MixRunFunc)(float * acc, int frames, MixVoice * const * voices, int count);
+
+struct MixKernel
+{
+  MixAddFunc add;    // voices at output rate, aligned to a source frame
+  MixRunFunc interp; // all other voices
+};
+
+static MixKernelType selected_kernel = MIX_KERNEL_AUTO;
+
+
+static inline bool is_unity(const MixVoice & v)
+{
+  return v.step == MIX_FIXED_ONE && uint32_t(v.pos) == 0;
+}
+
+
+static inline float clamp_sample(float value)
+{
+  return value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+}
+
+
+static void mix_add_scalar(float * acc, const float * src, int count, float volume)
+{
+  for (int i = 0; i < count; i++)
+    acc[i] += src[i] * volume;
+}
+
+
+// a run is a frame span where no voice reaches its end, so kernels need no bounds checks
+static void mix_interp_scalar(float * acc, int frames, MixVoice * const * voices, int count)
+{
+  for (int g = 0; g < count; g += MIX_GROUP)
+  {
+    int n = count - g < MIX_GROUP ? count - g : MIX_GROUP;
+    MixVoice * const * group = voices + g;
+
+    for (int f = 0; f < frames; f++)
+    {
+      float left = acc[f * 2];
+      float right = acc[f * 2 + 1];
+
+      for (int i = 0; i < n; i++)
+      {
+        MixVoice & v = *group[i];
+        const float * p = v.data + (v.pos >> 32) * 2;
+        float t = float(uint32_t(v.pos)) * (1.0f / 4294967296.0f);
+        left += (p[0] + (p[2] - p[0]) * t) * v.volume;
+        right += (p[1] + (p[3] - p[1]) * t) * v.volume;
+        v.pos += v.step;
+      }
+
+      acc[f * 2] = left;
+      acc[f * 2 + 1] = right;
+    }
+  }
+}
+
+
+static void mix_output_scalar(float * out, const float * acc, int frames, int channels)
+{
+  if (channels == 1)
+  {
+    for (int f = 0; f < frames; f++)
+      out[f] = clamp_sample((acc[f * 2] + acc[f * 2 + 1]) * 0.5f);
+
+    return;
+  }
+
+  // extra channels (e.g. rear speakers) repeat the front pair
+  for (int f = 0; f < frames; f++)
+  {
+    float left = clamp_sample(acc[f * 2]);
+    float right = clamp_sample(acc[f * 2 + 1]);
+
+    for (int ch = 0; ch < channels; ch++)
+      out[f * channels + ch] = (ch & 1) ? right : left;
+  }
+}
+
+
+struct StoreS16
+{
+  int16_t * out;
+  void operator()(int index, float value) const { out[index] = int16_t(value * 32766.0f); }
+};
+
+struct StoreS24
+{
+  uint8_t * out;
+  void operator()(int index, float value) const
+  {
+    int iv = int(value * 8388600.0f);
+    out[index * 3] = uint8_t(iv & 0xff);
+    out[index * 3 + 1] = uint8_t((iv >> 8) & 0xff);
+    out[index * 3 + 2] = uint8_t((iv >> 16) & 0xff);
+  }
+};
+
+struct StoreS32
+{
+  int32_t * out;
+  void operator()(int index, float value) const { out[index] = int32_t(value * 2147479000.0f); }
+};
+
+
+template <typename Store>
+static void mix_output_int_scalar(Store store, const float * acc, int frames, int channels)
+{
+  for (int f = 0; f < frames; f++)
+  {
+    float left = clamp_sample(acc[f * 2]);
+    float right = clamp_sample(acc[f * 2 + 1]);
+
+    if (channels == 1)
+      store(f, clamp_sample((acc[f * 2] + acc[f * 2 + 1]) * 0.5f));
+    else
+      for (int ch = 0; ch < channels; ch++)
+        store(f * channels + ch, (ch & 1) ? right : left);
+  }
+}
+
+
+#ifdef MIX_X86
+
+__attribute__((target("sse2")))
+static void mix_add_sse2(float * acc, const float * src, int count, float volume)
+{
+  const __m128 vol = _mm_set1_ps(volume);
+  const int blockCount = count / 8 * 8;
+
+  for (int i = 0; i < blockCount; i += 8)
+  {
+    __m128 a0 = _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(_mm_loadu_ps(src + i), vol));
+    __m128 a1 = _mm_add_ps(_mm_loadu_ps(acc + i + 4), _mm_mul_ps(_mm_loadu_ps(src + i + 4), vol));
+    _mm_storeu_ps(acc + i, a0);
+    _mm_storeu_ps(acc + i + 4, a1);
+  }
+
+  mix_add_scalar(acc + blockCount, src + blockCount, count - blockCount, volume);
+}
+
+
+// two stereo frames per vector
+__attribute__((target("sse2")))
+static void mix_interp_sse2(float * acc, int frames, MixVoice * const * voices, int count)
+{
+  const int lanes = 2;
+  const int blockFrames = frames / lanes * lanes;
+  const float fracScale = 1.0f / 4294967296.0f;
+
+  for (int g = 0; g < count; g += MIX_GROUP)
+  {
+    int n = count - g < MIX_GROUP ? count - g : MIX_GROUP;
+    MixVoice * const * group = voices + g;
+
+    for (int f = 0; f < blockFrames; f += lanes)
+    {
+      __m128 sum = _mm_loadu_ps(acc + f * 2);
+
+      for (int i = 0; i < n; i++)
+      {
+        MixVoice & v = *group[i];
+        uint64_t p0 = v.pos;
+        uint64_t p1 = v.pos + v.step;
+        const float * a = v.data + (p0 >> 32) * 2;
+        const float * b = v.data + (p1 >> 32) * 2;
+        float t0 = float(uint32_t(p0)) * fracScale;
+        float t1 = float(uint32_t(p1)) * fracScale;
+        __m128 x0 = _mm_setr_ps(a[0], a[1], b[0], b[1]);
+        __m128 x1 = _mm_setr_ps(a[2], a[3], b[2], b[3]);
+        __m128 t = _mm_setr_ps(t0, t0, t1, t1);
+        __m128 value = _mm_add_ps(x0, _mm_mul_ps(_mm_sub_ps(x1, x0), t));
+        sum = _mm_add_ps(sum, _mm_mul_ps(value, _mm_set1_ps(v.volume)));
+        v.pos += v.step * lanes;
+      }
+
+      _mm_storeu_ps(acc + f * 2, sum);
+    }
+  }
+
+  if (blockFrames < frames)
+    mix_interp_scalar(acc + blockFrames * 2, frames - blockFrames, voices, count);
+}
+
+
+__attribute__((target("avx2")))
+static void mix_add_avx2(float * acc, const float * src, int count, float volume)
+{
+  const __m256 vol = _mm256_set1_ps(volume);
+  const int blockCount = count / 16 * 16;
+
+  for (int i = 0; i < blockCount; i += 16)
+  {
+    __m256 a0 = _mm256_add_ps(_mm256_loadu_ps(acc + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), vol));
+    __m256 a1 = _mm256_add_ps(_mm256_loadu_ps(acc + i + 8), _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), vol));
+    _mm256_storeu_ps(acc + i, a0);
+    _mm256_storeu_ps(acc + i + 8, a1);
+  }
+
+  mix_add_scalar(acc + blockCount, src + blockCount, count - blockCount, volume);
+}
+
+
+// four stereo frames per vector
+__attribute__((target("avx2")))
+static void mix_interp_avx2(float * acc, int frames, MixVoice * const * voices, int count)
+{
+  const int lanes = 4;
+  const int blockFrames = frames / lanes * lanes;
+  const float fracScale = 1.0f / 4294967296.0f;
+
+  for (int g = 0; g < count; g += MIX_GROUP)
+  {
+    int n = count - g < MIX_GROUP ? count - g : MIX_GROUP;
+    MixVoice * const * group = voices + g;
+
+    for (int f = 0; f < blockFrames; f += lanes)
+    {
+      __m256 sum = _mm256_loadu_ps(acc + f * 2);
+
+      for (int i = 0; i < n; i++)
+      {
+        MixVoice & v = *group[i];
+        const float * p[lanes];
+        float t[lanes];
+        uint64_t pos = v.pos;
+
+        for (int l = 0; l < lanes; l++)
+        {
+          p[l] = v.data + (pos >> 32) * 2;
+          t[l] = float(uint32_t(pos)) * fracScale;
+          pos += v.step;
+        }
+
+        __m256 x0 = _mm256_setr_ps(p[0][0], p[0][1], p[1][0], p[1][1], p[2][0], p[2][1], p[3][0], p[3][1]);
+        __m256 x1 = _mm256_setr_ps(p[0][2], p[0][3], p[1][2], p[1][3], p[2][2], p[2][3], p[3][2], p[3][3]);
+        __m256 tv = _mm256_setr_ps(t[0], t[0], t[1], t[1], t[2], t[2], t[3], t[3]);
+        __m256 value = _mm256_add_ps(x0, _mm256_mul_ps(_mm256_sub_ps(x1, x0), tv));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(value, _mm256_set1_ps(v.volume)));
+        v.pos = pos;
+      }
+
+      _mm256_storeu_ps(acc + f * 2, sum);
+    }
+  }
+
+  if (blockFrames < frames)
+    mix_interp_scalar(acc + blockFrames * 2, frames - blockFrames, voices, count);
+}
+
+
+__attribute__((target("sse2")))
+static void mix_output_sse2(float * out, const float * acc, int frames, int channels)
+{
+  if (channels != 1 && channels != 2)
+  {
+    mix_output_scalar(out, acc, frames, channels);
+    return;
+  }
+
+  const __m128 minValue = _mm_set1_ps(-1.0f);
+  const __m128 maxValue = _mm_set1_ps(1.0f);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const int blockFrames = frames / 4 * 4;
+
+  for (int f = 0; f < blockFrames; f += 4)
+  {
+    __m128 a = _mm_loadu_ps(acc + f * 2);
+    __m128 b = _mm_loadu_ps(acc + f * 2 + 4);
+
+    if (channels == 2)
+    {
+      _mm_storeu_ps(out + f * 2, _mm_min_ps(_mm_max_ps(a, minValue), maxValue));
+      _mm_storeu_ps(out + f * 2 + 4, _mm_min_ps(_mm_max_ps(b, minValue), maxValue));
+    }
+    else
+    {
+      __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+      __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+      __m128 value = _mm_mul_ps(_mm_add_ps(left, right), half);
+      _mm_storeu_ps(out + f, _mm_min_ps(_mm_max_ps(value, minValue), maxValue));
+    }
+  }
+
+  mix_output_scalar(out + blockFrames * channels, acc + blockFrames * 2, frames - blockFrames, channels);
+}
+
+
+// stereo only, the most common device format
+__attribute__((target("sse2")))
+static void mix_output_s16_stereo_sse2(int16_t * out, const float * acc, int frames)
+{
+  const __m128 minValue = _mm_set1_ps(-1.0f);
+  const __m128 maxValue = _mm_set1_ps(1.0f);
+  const __m128 scale = _mm_set1_ps(32766.0f);
+  const int blockFrames = frames / 4 * 4;
+
+  for (int f = 0; f < blockFrames; f += 4)
+  {
+    __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(acc + f * 2), minValue), maxValue);
+    __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(acc + f * 2 + 4), minValue), maxValue);
+    __m128i ia = _mm_cvttps_epi32(_mm_mul_ps(a, scale));
+    __m128i ib = _mm_cvttps_epi32(_mm_mul_ps(b, scale));
+    _mm_storeu_si128((__m128i *)(out + f * 2), _mm_packs_epi32(ia, ib));
+  }
+
+  StoreS16 store = { out + blockFrames * 2 };
+  mix_output_int_scalar(store, acc + blockFrames * 2, frames - blockFrames, 2);
+}
+
+#endif
+
+
+bool mix_kernel_supported(MixKernelType type)
+{
+  switch (type)
+  {
+  case MIX_KERNEL_SCALAR:
+  case MIX_KERNEL_AUTO:
+    return true;
+#ifdef MIX_X86
+  case MIX_KERNEL_SSE2:
+    return __builtin_cpu_supports("sse2");
+  case MIX_KERNEL_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+
+static MixKernelType resolve_kernel()
+{
+  if (const char * env = getenv("MMC_MIX_KERNEL"))
+  {
+    for (int type = MIX_KERNEL_SCALAR; type < MIX_KERNEL_AUTO; type++)
+      if (!strcmp(env, mix_kernel_name(MixKernelType(type))))
+      {
+        if (mix_kernel_supported(MixKernelType(type)))
+          return MixKernelType(type);
+
+        printf("ERROR: mix kernel '%s' is not supported by CPU\n", env);
+      }
+  }
+
+  if (mix_kernel_supported(MIX_KERNEL_AVX2))
+    return MIX_KERNEL_AVX2;
+
+  if (mix_kernel_supported(MIX_KERNEL_SSE2))
+    return MIX_KERNEL_SSE2;
+
+  return MIX_KERNEL_SCALAR;
+}
+
+
+void mix_kernel_select(MixKernelType type)
+{
+  selected_kernel = (type == MIX_KERNEL_AUTO || !mix_kernel_supported(type)) ? resolve_kernel() : type;
+}
+
+
+MixKernelType mix_kernel_selected()
+{
+  if (selected_kernel == MIX_KERNEL_AUTO)
+    selected_kernel = resolve_kernel();
+
+  return selected_kernel;
+}
+
+
+const char * mix_kernel_name(MixKernelType type)
+{
+  switch (type)
+  {
+  case MIX_KERNEL_SCALAR:
+    return "scalar";
+  case MIX_KERNEL_SSE2:
+    return "sse2";
+  case MIX_KERNEL_AVX2:
+    return "avx2";
+  default:
+    return "auto";
+  }
+}
+
+
+static MixKernel get_kernel()
+{
+  MixKernel kernel;
+
+  switch (mix_kernel_selected())
+  {
+#ifdef MIX_X86
+  case MIX_KERNEL_SSE2:
+    kernel.add = mix_add_sse2;
+    kernel.interp = mix_interp_sse2;
+    break;
+  case MIX_KERNEL_AVX2:
+    kernel.add = mix_add_avx2;
+    kernel.interp = mix_interp_avx2;
+    break;
+#endif
+  default:
+    kernel.add = mix_add_scalar;
+    kernel.interp = mix_interp_scalar;
+    break;
+  }
+
+  return kernel;
+}
+
+
+// unity voices are added one by one, the rest is interpolated in groups
+static void mix_run(const MixKernel & kernel, float * acc, int frames, MixVoice * const * voices, int count)
+{
+  MixVoice * interpolated[MIX_BATCH];
+  int interpolated_count = 0;
+
+  for (int i = 0; i < count; i++)
+  {
+    MixVoice & v = *voices[i];
+
+    if (is_unity(v))
+    {
+      kernel.add(acc, v.data + (v.pos >> 32) * 2, frames * 2, v.volume);
+      v.pos += uint64_t(frames) << 32;
+    }
+    else
+      interpolated[interpolated_count++] = &v;
+  }
+
+  if (interpolated_count)
+    kernel.interp(acc, frames, interpolated, interpolated_count);
+}
+
+
+void mix_voices(float * acc, int frames, MixVoice * const * voices, int count)
+{
+  MixKernel kernel = get_kernel();
+
+  for (int first = 0; first < count; first += MIX_BATCH)
+  {
+    MixVoice * active[MIX_BATCH];
+    int active_count = 0;
+
+    for (int i = first; i < count && i < first + MIX_BATCH; i++)
+      if (voices[i]->playing && voices[i]->end > voices[i]->begin)
+        active[active_count++] = voices[i];
+      else
+        voices[i]->playing = false;
+
+    int done = 0;
+
+    while (done < frames && active_count > 0)
+    {
+      int run = frames - done;
+
+      for (int i = 0; i < active_count; i++)
+      {
+        const MixVoice & v = *active[i];
+
+        if (v.step && v.pos < v.end)
+        {
+          uint64_t left = (v.end - v.pos + v.step - 1) / v.step;
+
+          if (left < (uint64_t)run)
+            run = int(left);
+        }
+      }
+
+      if (run > 0)
+        mix_run(kernel, acc + done * 2, run, active, active_count);
+
+      done += run;
+
+      // wrap looped voices, drop finished ones
+      for (int i = 0; i < active_count;)
+      {
+        MixVoice & v = *active[i];
+
+        if (v.pos < v.end)
+          i++;
+        else if (v.loop)
+        {
+          v.pos = v.begin;
+          i++;
+        }
+        else
+        {
+          v.playing = false;
+          active[i] = active[--active_count];
+        }
+      }
+    }
+  }
+}
+
+
+void mix_output(float * out, const float * acc, int frames, int channels)
+{
+#ifdef MIX_X86
+  if (mix_kernel_selected() != MIX_KERNEL_SCALAR)
+  {
+    mix_output_sse2(out, acc, frames, channels);
+    return;
+  }
+#endif
+
+  mix_output_scalar(out, acc, frames, channels);
+}
+
+
+void mix_output_s16(int16_t * out, const float * acc, int frames, int channels)
+{
+#ifdef MIX_X86
+  if (channels == 2 && mix_kernel_selected() != MIX_KERNEL_SCALAR)
+  {
+    mix_output_s16_stereo_sse2(out, acc, frames);
+    return;
+  }
+#endif
+
+  StoreS16 store = { out };
+  mix_output_int_scalar(store, acc, frames, channels);
+}
+
+
+void mix_output_s24(uint8_t * out, const float * acc, int frames, int channels)
+{
+  StoreS24 store = { out };
+  mix_output_int_scalar(store, acc, frames, channels);
+}
+
+
+void mix_output_s32(int32_t * out, const float * acc, int frames, int channels)
+{
+  StoreS32 store = { out };
+  mix_output_int_scalar(store, acc, frames, channels);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+// Software mixer kernels. Sounds are interleaved stereo, positions use a 32.32 fixed
+// point frame accumulator. Voices at the output rate (sounds are resampled at load time)
+// are added straight into an interleaved stereo accumulator, other voices are linearly
+// interpolated. The accumulator is clamped and mapped to the output channels in one pass.
+// The implementation is picked at runtime (AVX2, SSE2 or scalar) and can be forced
+// with MMC_MIX_KERNEL=avx2|sse2|scalar.
+
+#define MIX_FIXED_ONE (uint64_t(1) << 32)
+
+struct MixVoice
+{
+  const float * data; // stereo frames, one guard frame after 'end' is required for interpolation
+  uint64_t pos;       // 32.32
+  uint64_t step;      // 32.32
+  uint64_t begin;     // 32.32, loop restarts here
+  uint64_t end;       // 32.32
+  float volume;
+  bool loop;
+  bool playing;
+};
+
+enum MixKernelType
+{
+  MIX_KERNEL_SCALAR,
+  MIX_KERNEL_SSE2,
+  MIX_KERNEL_AVX2,
+  MIX_KERNEL_AUTO
+};
+
+bool mix_kernel_supported(MixKernelType type);
+void mix_kernel_select(MixKernelType type);
+MixKernelType mix_kernel_selected();
+const char * mix_kernel_name(MixKernelType type);
+
+// adds 'count' voices into stereo 'acc' (frames * 2), handles loop wraps and stops ('playing' is cleared)
+void mix_voices(float * acc, int frames, MixVoice * const * voices, int count);
+
+// mono output gets (left + right) / 2, extra channels repeat the front pair, values are clamped to [-1, 1]
+void mix_output(float * out, const float * acc, int frames, int channels);
+
+// same mapping converted to integer device formats (scales match the ALSA converter),
+// so the final pass can write straight into a mapped device buffer
+void mix_output_s16(int16_t * out, const float * acc, int frames, int channels);
+void mix_output_s24(uint8_t * out, const float * acc, int frames, int channels); // packed little endian
+void mix_output_s32(int32_t * out, const float * acc, int frames, int channels);
@@ -96,10 +96,26 @@ public:
   virtual void onAudioRecorded(float * data, int frames_count, const BufferSettings * buffer_settings) = 0;
 };
 
+enum MmcSampleFormat
+{
+  MMC_SAMPLE_FLOAT,
+  MMC_SAMPLE_S16,
+  MMC_SAMPLE_S24_3, // packed little endian
+  MMC_SAMPLE_S32
+};
+
 class IPcmPlayCallback
 {
 public:
   virtual void onAudioPlay(float * data, int frames_count, const BufferSettings * buffer_settings) = 0;
+
+  // Optional: renders interleaved samples in device format straight into 'data' (which can be
+  // the mapped device buffer). Returns false when not supported, then onAudioPlay() output is converted.
+  virtual bool onAudioPlayFormat(void * data, MmcSampleFormat format, int frames_count,
+                                 const BufferSettings * buffer_settings)
+  {
+    return false;
+  }
 };
 
 class IMidiCallback
@@ -152,3 +168,32 @@ void mmc_ex_finlaize();
 
 bool mmc_ex_need_restart();
 
+// measured playback delay (snd_pcm_delay after the last write), seconds
+double mmc_ex_get_play_latency();
+
+// Playback buffering for outputs started after the call, values <= 0 keep defaults.
+// MMC_PERIOD_FRAMES and MMC_PERIODS environment variables override requested values.
+void mmc_set_play_buffer(int period_frames, int periods);
+void mmc_get_play_buffer(int * period_frames, int * periods);
+// lower bound for the period, raised by the output after repeated xruns
+void mmc_set_min_play_period(int period_frames);
+
+// Pluggable PCM output. The backend is selected by MMC_OUTPUT environment variable:
+//   "alsa" (default)  - sound card through mmc_ex_init()
+//   "null"            - discards audio, clocked by a timer like a real device
+//   "null-fast"       - discards audio, renders as fast as possible
+//   "wav:<file>"      - writes 32-bit float WAV, clocked by a timer
+//   "wav-fast:<file>" - writes 32-bit float WAV as fast as possible
+class IPcmOutput
+{
+public:
+  virtual ~IPcmOutput() {}
+  virtual const char * getName() const = 0;
+  virtual bool needRestart() = 0;
+  virtual double getLatency() = 0; // seconds until the most recently rendered sample is played
+};
+
+// returns started output or NULL on failure
+IPcmOutput * mmc_output_create(IPcmPlayCallback * pcm_play_callback);
+IPcmOutput * mmc_output_create(const char * spec, IPcmPlayCallback * pcm_play_callback);
+
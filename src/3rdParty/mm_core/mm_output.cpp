@@ -0,0 +1,366 @@
+#include "mm_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <atomic>
+
+#define MMC_MAX_PERIOD_FRAMES 4096
+
+static int requested_period_frames = 0;
+static int requested_periods = 0;
+static int min_period_frames = 0;
+
+
+static int env_int(const char * name)
+{
+  const char * value = getenv(name);
+  return value ? atoi(value) : 0;
+}
+
+
+void mmc_set_play_buffer(int period_frames, int periods)
+{
+  requested_period_frames = period_frames;
+  requested_periods = periods;
+}
+
+
+void mmc_get_play_buffer(int * period_frames, int * periods)
+{
+  int frames = env_int("MMC_PERIOD_FRAMES");
+  int count = env_int("MMC_PERIODS");
+
+  if (frames <= 0)
+    frames = requested_period_frames > 0 ? requested_period_frames : MMC_BUF_SIZE;
+
+  if (count <= 0)
+    count = requested_periods > 0 ? requested_periods : MMC_PLAY_BUFFERS;
+
+  if (frames < min_period_frames)
+    frames = min_period_frames;
+
+  *period_frames = frames < 16 ? 16 : (frames > MMC_MAX_PERIOD_FRAMES ? MMC_MAX_PERIOD_FRAMES : frames);
+  *periods = count < 2 ? 2 : (count > 16 ? 16 : count);
+}
+
+
+void mmc_set_min_play_period(int period_frames)
+{
+  min_period_frames = period_frames;
+}
+
+
+// sound card output through the ALSA wrapper
+class AlsaOutput : public IPcmOutput
+{
+public:
+  bool start(IPcmPlayCallback * pcm_play_callback)
+  {
+    return mmc_ex_init(NULL, pcm_play_callback, NULL);
+  }
+
+  virtual ~AlsaOutput()
+  {
+    mmc_ex_finlaize();
+  }
+
+  virtual const char * getName() const
+  {
+    return "alsa";
+  }
+
+  virtual bool needRestart()
+  {
+    return mmc_ex_need_restart();
+  }
+
+  virtual double getLatency()
+  {
+    return mmc_ex_get_play_latency();
+  }
+};
+
+
+// Offline output: renders one period per iteration on own thread.
+// Clocked mode sleeps until the absolute deadline of the next buffer (like a device
+// consuming samples in real time), fast mode renders back to back.
+class OfflineOutput : public IPcmOutput
+{
+  IPcmPlayCallback * callback;
+  BufferSettings settings;
+  float * buffer;
+  int periodFrames;
+  int periods;
+  bool clocked;
+  std::atomic<bool> exiting;
+  pthread_t thread;
+  bool threadCreated;
+
+  static void * threadFunc(void * arg)
+  {
+    ((OfflineOutput *)arg)->run();
+    return NULL;
+  }
+
+  void run()
+  {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    long long bufferNsec = 1000000000LL * periodFrames / MMC_FREQ;
+
+    while (!exiting.load(std::memory_order_acquire))
+    {
+      memset(buffer, 0, periodFrames * settings.channels * sizeof(float));
+      callback->onAudioPlay(buffer, periodFrames, &settings);
+
+      if (!write(buffer, periodFrames))
+        break;
+
+      if (clocked)
+      {
+        deadline.tv_nsec += bufferNsec;
+        while (deadline.tv_nsec >= 1000000000L)
+        {
+          deadline.tv_nsec -= 1000000000L;
+          deadline.tv_sec++;
+        }
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+          ;
+      }
+    }
+  }
+
+protected:
+  virtual bool write(const float * data, int frames_count) = 0;
+
+  void stop()
+  {
+    exiting.store(true, std::memory_order_release);
+
+    if (threadCreated)
+    {
+      pthread_join(thread, NULL);
+      threadCreated = false;
+    }
+  }
+
+public:
+  OfflineOutput(bool clocked_) :
+    callback(NULL),
+    buffer(NULL),
+    periodFrames(MMC_BUF_SIZE),
+    periods(MMC_PLAY_BUFFERS),
+    clocked(clocked_),
+    exiting(false),
+    threadCreated(false)
+  {
+    settings.channels = MMC_PLAY_CHANNELS;
+    settings.freq = MMC_FREQ;
+    settings.invChannels = 1.0 / MMC_PLAY_CHANNELS;
+    settings.invFreq = 1.0 / MMC_FREQ;
+    settings.sampleTime = 1.0 / MMC_FREQ;
+  }
+
+  virtual ~OfflineOutput()
+  {
+    stop();
+    delete[] buffer;
+  }
+
+  bool start(IPcmPlayCallback * pcm_play_callback)
+  {
+    callback = pcm_play_callback;
+    mmc_get_play_buffer(&periodFrames, &periods);
+    buffer = new float[periodFrames * MMC_PLAY_CHANNELS];
+
+    if (pthread_create(&thread, NULL, threadFunc, this) != 0)
+    {
+      printf("ERROR: pthread_create failed\n");
+      return false;
+    }
+
+    threadCreated = true;
+    return true;
+  }
+
+  virtual bool needRestart()
+  {
+    return false;
+  }
+
+  // nominal, as if a device queued all periods
+  virtual double getLatency()
+  {
+    return clocked ? double(periodFrames) * periods / MMC_FREQ : 0.0;
+  }
+};
+
+
+class NullOutput : public OfflineOutput
+{
+protected:
+  virtual bool write(const float *, int)
+  {
+    return true;
+  }
+
+public:
+  NullOutput(bool clocked) : OfflineOutput(clocked) {}
+
+  virtual ~NullOutput()
+  {
+    stop();
+  }
+
+  virtual const char * getName() const
+  {
+    return "null";
+  }
+};
+
+
+// 32-bit float WAV, sizes in RIFF header are patched on close
+class WavOutput : public OfflineOutput
+{
+  FILE * file;
+  uint32_t dataSize;
+
+  static void writeU32(unsigned char * p, uint32_t v)
+  {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+  }
+
+  static void writeU16(unsigned char * p, uint16_t v)
+  {
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+  }
+
+  void writeHeader()
+  {
+    unsigned char header[44];
+    memcpy(header, "RIFF", 4);
+    writeU32(header + 4, 36 + dataSize);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    writeU32(header + 16, 16);
+    writeU16(header + 20, 3); // WAVE_FORMAT_IEEE_FLOAT
+    writeU16(header + 22, MMC_PLAY_CHANNELS);
+    writeU32(header + 24, MMC_FREQ);
+    writeU32(header + 28, MMC_FREQ * MMC_PLAY_CHANNELS * sizeof(float));
+    writeU16(header + 32, MMC_PLAY_CHANNELS * sizeof(float));
+    writeU16(header + 34, 32);
+    memcpy(header + 36, "data", 4);
+    writeU32(header + 40, dataSize);
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(header, sizeof(header), 1, file);
+  }
+
+protected:
+  virtual bool write(const float * data, int frames_count)
+  {
+    size_t size = frames_count * MMC_PLAY_CHANNELS * sizeof(float);
+
+    if (uint64_t(dataSize) + size > 0xffffffffULL - 36)
+    {
+      printf("ERROR: WAV output is full\n");
+      return false;
+    }
+
+    if (fwrite(data, size, 1, file) != 1)
+    {
+      printf("ERROR: cannot write WAV output\n");
+      return false;
+    }
+
+    dataSize += uint32_t(size);
+    return true;
+  }
+
+public:
+  WavOutput(bool clocked) : OfflineOutput(clocked), file(NULL), dataSize(0) {}
+
+  virtual ~WavOutput()
+  {
+    stop();
+
+    if (file)
+    {
+      writeHeader();
+      fclose(file);
+    }
+  }
+
+  bool open(const char * file_name)
+  {
+    file = fopen(file_name, "wb");
+
+    if (!file)
+    {
+      printf("ERROR: cannot create WAV output '%s'\n", file_name);
+      return false;
+    }
+
+    writeHeader();
+    return true;
+  }
+
+  virtual const char * getName() const
+  {
+    return "wav";
+  }
+};
+
+
+IPcmOutput * mmc_output_create(const char * spec, IPcmPlayCallback * pcm_play_callback)
+{
+  if (!spec || !*spec || !strcmp(spec, "alsa"))
+  {
+    AlsaOutput * output = new AlsaOutput();
+    if (output->start(pcm_play_callback))
+      return output;
+
+    delete output;
+    return NULL;
+  }
+
+  if (!strcmp(spec, "null") || !strcmp(spec, "null-fast"))
+  {
+    NullOutput * output = new NullOutput(!strcmp(spec, "null"));
+    if (output->start(pcm_play_callback))
+      return output;
+
+    delete output;
+    return NULL;
+  }
+
+  bool wavClocked = !strncmp(spec, "wav:", 4);
+  bool wavFast = !strncmp(spec, "wav-fast:", 9);
+
+  if (wavClocked || wavFast)
+  {
+    WavOutput * output = new WavOutput(wavClocked);
+    if (output->open(strchr(spec, ':') + 1) && output->start(pcm_play_callback))
+      return output;
+
+    delete output;
+    return NULL;
+  }
+
+  printf("ERROR: unknown MMC_OUTPUT '%s'\n", spec);
+  return NULL;
+}
+
+
+IPcmOutput * mmc_output_create(IPcmPlayCallback * pcm_play_callback)
+{
+  return mmc_output_create(getenv("MMC_OUTPUT"), pcm_play_callback);
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 #include <stdint.h>
 
@@ -25,3 +26,11 @@ inline uint32_t get_time_usec()
   return uint32_t(useconds);
 }
 
+
+// monotonic, for measuring durations
+inline uint64_t get_monotonic_usec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000ULL + uint64_t(ts.tv_nsec) / 1000;
+}
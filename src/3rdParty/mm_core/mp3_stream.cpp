@@ -0,0 +1,362 @@
+#include "mp3_stream.h"
+
+#include "mm_core.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+
+Mp3Stream::Mp3Stream() :
+  data(NULL),
+  size(0),
+  mapping(NULL),
+  mappingSize(0),
+  hz(0),
+  channels(0),
+  length(0),
+  loop(false),
+  loopBegin(0),
+  loopEnd(0),
+  nextFrame(0),
+  skipUntil(0),
+  prevLeft(0.0f),
+  prevRight(0.0f),
+  phase(0.0),
+  step(1.0),
+  maxFrameOutput(0),
+  writePos(0),
+  readPos(0),
+  decoderFinished(true),
+  exiting(false),
+  threadStarted(false)
+{
+  memset(&dec, 0, sizeof(dec));
+}
+
+
+Mp3Stream::~Mp3Stream()
+{
+  close();
+}
+
+
+bool Mp3Stream::open(const uint8_t * data_, size_t size_)
+{
+  close();
+  data = data_;
+  size = size_;
+
+  if (!buildIndex())
+  {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+
+bool Mp3Stream::openFile(const char * file_name)
+{
+  close();
+
+  int fd = ::open(file_name, O_RDONLY);
+
+  if (fd < 0)
+  {
+    printf("ERROR: cannot open .mp3-file '%s'\n", file_name);
+    return false;
+  }
+
+  struct stat st;
+
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+    mapping = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (mapping == MAP_FAILED)
+      mapping = NULL;
+    else
+      mappingSize = (size_t)st.st_size;
+  }
+
+  ::close(fd);
+
+  if (!mapping)
+  {
+    printf("ERROR: cannot map .mp3-file '%s'\n", file_name);
+    return false;
+  }
+
+  madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+  data = (const uint8_t *)mapping;
+  size = mappingSize;
+
+  if (!buildIndex())
+  {
+    printf("ERROR: cannot load .mp3-file '%s'\n", file_name);
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+
+void Mp3Stream::close()
+{
+  stop();
+
+  if (mapping)
+    munmap(mapping, mappingSize);
+
+  mapping = NULL;
+  mappingSize = 0;
+  data = NULL;
+  size = 0;
+  frames.clear();
+  hz = 0;
+  channels = 0;
+  length = 0;
+}
+
+
+// scans frame headers only, so seeking for the loop does not need to decode from the beginning
+bool Mp3Stream::buildIndex()
+{
+  size_t pos = 0;
+
+  if (size > 10 && !memcmp(data, "ID3", 3))
+    pos = (((data[6] & 0x7f) << 21) | ((data[7] & 0x7f) << 14) | ((data[8] & 0x7f) << 7) | (data[9] & 0x7f)) + 10;
+
+  mp3dec_t scan;
+  mp3dec_init(&scan);
+  mp3dec_frame_info_t info;
+  int samples_total = 0;
+
+  while (pos < size)
+  {
+    memset(&info, 0, sizeof(info));
+    int samples = mp3dec_decode_frame(&scan, data + pos, int(std::min(size - pos, (size_t)0x7fffffff)), NULL, &info);
+
+    if (!info.frame_bytes)
+      break;
+
+    if (samples)
+    {
+      if (!hz)
+      {
+        hz = info.hz;
+        channels = info.channels;
+      }
+      else if (info.hz != hz || info.channels != channels)
+        break;
+
+      FrameIndex frame;
+      frame.offset = uint32_t(pos);
+      frame.firstSample = uint32_t(samples_total);
+      frames.push_back(frame);
+      samples_total += samples;
+    }
+
+    pos += info.frame_bytes;
+  }
+
+  length = samples_total;
+
+  if (frames.empty() || hz <= 0 || (channels != 1 && channels != 2))
+    return false;
+
+  step = double(hz) / MMC_FREQ;
+  maxFrameOutput = int(MINIMP3_MAX_SAMPLES_PER_FRAME / 2 / step) + 4;
+
+  return true;
+}
+
+
+void Mp3Stream::setLoop(bool loop_, int begin_sample, int end_sample)
+{
+  loopBegin = std::max(0, std::min(begin_sample, length));
+  loopEnd = std::max(loopBegin.load(), std::min(end_sample, length));
+  loop = loop_ && loopEnd > loopBegin;
+}
+
+
+bool Mp3Stream::start(int begin_sample)
+{
+  stop();
+
+  if (frames.empty())
+    return false;
+
+  writePos = 0;
+  readPos = 0;
+  prevLeft = 0.0f;
+  prevRight = 0.0f;
+  phase = 0.0;
+  decoderFinished = false;
+  exiting = false;
+  seek(std::max(0, std::min(begin_sample, length)));
+
+  // prefill, so the first audio buffers do not underrun while the thread spins up
+  while (!decoderFinished && getFreeSpace() >= maxFrameOutput && getFreeSpace() > RING_FRAMES / 2)
+    decodeNextFrame();
+
+  if (pthread_create(&thread, NULL, threadFunc, this) != 0)
+  {
+    printf("ERROR: pthread_create failed\n");
+    return false;
+  }
+
+  threadStarted = true;
+
+  return true;
+}
+
+
+void Mp3Stream::stop()
+{
+  if (threadStarted)
+  {
+    exiting = true;
+    pthread_join(thread, NULL);
+    threadStarted = false;
+  }
+
+  decoderFinished = true;
+}
+
+
+int Mp3Stream::read(float * out, int count)
+{
+  uint32_t r = readPos.load(std::memory_order_relaxed);
+  uint32_t w = writePos.load(std::memory_order_acquire);
+  int n = std::min(count, int(w - r));
+
+  for (int i = 0; i < n; i++)
+  {
+    const float * frame = ring + ((r + i) & (RING_FRAMES - 1)) * 2;
+    out[i * 2] = frame[0];
+    out[i * 2 + 1] = frame[1];
+  }
+
+  readPos.store(r + n, std::memory_order_release);
+
+  return n;
+}
+
+
+bool Mp3Stream::isFinished() const
+{
+  return decoderFinished && readPos.load(std::memory_order_relaxed) == writePos.load(std::memory_order_acquire);
+}
+
+
+void Mp3Stream::seek(int sample)
+{
+  FrameIndex key;
+  key.offset = 0;
+  key.firstSample = uint32_t(sample);
+  std::vector<FrameIndex>::const_iterator it =
+    std::upper_bound(frames.begin(), frames.end(), key,
+                     [](const FrameIndex & a, const FrameIndex & b) { return a.firstSample < b.firstSample; });
+  size_t frame = it == frames.begin() ? 0 : size_t(it - frames.begin()) - 1;
+
+  mp3dec_init(&dec);
+  nextFrame = frame > PREROLL_FRAMES ? frame - PREROLL_FRAMES : 0;
+  skipUntil = sample;
+}
+
+
+void Mp3Stream::decodeNextFrame()
+{
+  if (nextFrame >= frames.size())
+  {
+    if (loop)
+      seek(loopBegin);
+    else
+      decoderFinished = true;
+
+    return;
+  }
+
+  const FrameIndex & frame = frames[nextFrame++];
+  mp3dec_frame_info_t info;
+  int samples = mp3dec_decode_frame(&dec, data + frame.offset, int(std::min(size - frame.offset, (size_t)0x7fffffff)),
+                                    pcm, &info);
+  int end = loop ? loopEnd.load() : length;
+
+  for (int i = 0; i < samples; i++)
+  {
+    int sample = int(frame.firstSample) + i;
+
+    if (sample < skipUntil)
+      continue;
+
+    if (sample >= end)
+    {
+      if (loop)
+        seek(loopBegin);
+      else
+      {
+        nextFrame = frames.size();
+        decoderFinished = true;
+      }
+
+      return;
+    }
+
+    if (info.channels == 2)
+      pushFrame(pcm[i * 2], pcm[i * 2 + 1]);
+    else
+      pushFrame(pcm[i], pcm[i]);
+  }
+}
+
+
+// linear resampling to MMC_FREQ, continuous across loop jumps
+void Mp3Stream::pushFrame(float left, float right)
+{
+  uint32_t w = writePos.load(std::memory_order_relaxed);
+
+  while (phase < 1.0)
+  {
+    float * frame = ring + (w & (RING_FRAMES - 1)) * 2;
+    frame[0] = prevLeft + (left - prevLeft) * float(phase);
+    frame[1] = prevRight + (right - prevRight) * float(phase);
+    w++;
+    phase += step;
+  }
+
+  phase -= 1.0;
+  prevLeft = left;
+  prevRight = right;
+  writePos.store(w, std::memory_order_release);
+}
+
+
+int Mp3Stream::getFreeSpace() const
+{
+  return RING_FRAMES - int(writePos.load(std::memory_order_relaxed) - readPos.load(std::memory_order_acquire));
+}
+
+
+void * Mp3Stream::threadFunc(void * arg)
+{
+  Mp3Stream & stream = *(Mp3Stream *)arg;
+
+  while (!stream.exiting)
+  {
+    if (!stream.decoderFinished && stream.getFreeSpace() >= stream.maxFrameOutput)
+      stream.decodeNextFrame();
+    else
+      sleep_msec(5);
+  }
+
+  return NULL;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+#ifndef MINIMP3_FLOAT_OUTPUT
+#  define MINIMP3_FLOAT_OUTPUT
+#endif
+#include "minimp3.h"
+
+// Streaming MP3 playback: a decoder thread decodes frame by frame into a lock-free
+// single producer / single consumer ring of interleaved stereo frames at MMC_FREQ.
+// The audio thread consumes it with read(). Loop points are in source samples.
+class Mp3Stream
+{
+public:
+  Mp3Stream();
+  ~Mp3Stream();
+
+  bool open(const uint8_t * data, size_t size); // data must outlive the stream
+  bool openFile(const char * file_name);
+  void close();
+
+  int getHz() const { return hz; }
+  int getLength() const { return length; }
+  void setLoop(bool loop, int begin_sample, int end_sample);
+
+  bool start(int begin_sample);
+  void stop();
+
+  int read(float * out, int count); // 'count' stereo frames, audio thread only
+  bool isFinished() const;
+
+private:
+  static const int RING_FRAMES = 32768; // power of two, ~0.75 s at 44100
+  static const int PREROLL_FRAMES = 3; // bit reservoir may reference previous frames
+
+  struct FrameIndex
+  {
+    uint32_t offset;
+    uint32_t firstSample;
+  };
+
+  const uint8_t * data;
+  size_t size;
+  void * mapping;
+  size_t mappingSize;
+  std::vector<FrameIndex> frames;
+  int hz;
+  int channels;
+  int length;
+
+  std::atomic<bool> loop;
+  std::atomic<int> loopBegin;
+  std::atomic<int> loopEnd;
+
+  // decoder thread state
+  mp3dec_t dec;
+  mp3d_sample_t pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
+  size_t nextFrame;
+  int skipUntil;
+  float prevLeft;
+  float prevRight;
+  double phase;
+  double step;
+  int maxFrameOutput;
+
+  float ring[RING_FRAMES * 2];
+  std::atomic<uint32_t> writePos;
+  std::atomic<uint32_t> readPos;
+  std::atomic<bool> decoderFinished;
+  std::atomic<bool> exiting;
+  pthread_t thread;
+  bool threadStarted;
+
+  bool buildIndex();
+  void seek(int sample);
+  void decodeNextFrame();
+  void pushFrame(float left, float right);
+  int getFreeSpace() const;
+  static void * threadFunc(void * arg);
+};
@@ -0,0 +1,220 @@
+#include "pcm_cache.h"
+
+#include "mm_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+
+#define PCM_CACHE_VERSION 2
+
+struct PcmCacheHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t freq;
+  int32_t length;
+  float advance;
+  uint32_t reserved;
+  PcmCacheKey key;
+};
+
+
+static uint64_t fnv1a(const void * data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+  const unsigned char * p = (const unsigned char *)data;
+
+  for (size_t i = 0; i < size; i++)
+  {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+
+static bool make_dir(const std::string & path)
+{
+  return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+
+static bool get_cache_dir(std::string & dir)
+{
+  static int state = -1; // -1 - unknown, 0 - disabled, 1 - ready
+  static std::string cache_dir;
+
+  if (state < 0)
+  {
+    state = 0;
+
+    if (const char * env = getenv("MMC_PCM_CACHE_DIR"))
+    {
+      cache_dir = env;
+
+      if (!cache_dir.empty() && make_dir(cache_dir))
+        state = 1;
+    }
+    else
+    {
+      const char * xdg = getenv("XDG_CACHE_HOME");
+      const char * home = getenv("HOME");
+      std::string base;
+
+      if (xdg && xdg[0])
+        base = xdg;
+      else if (home && home[0])
+        base = std::string(home) + "/.cache";
+
+      if (!base.empty() && make_dir(base))
+      {
+        cache_dir = base + "/TetrisGL";
+
+        if (make_dir(cache_dir))
+          state = 1;
+      }
+    }
+  }
+
+  dir = cache_dir;
+  return state == 1;
+}
+
+
+static std::string get_blob_name(const std::string & dir, const PcmCacheKey & key)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "/%016llx.pcm", (unsigned long long)key.nameHash);
+  return dir + name;
+}
+
+
+bool pcm_cache_key_for_file(const char * file_name, PcmCacheKey * key)
+{
+  struct stat st;
+  memset(key, 0, sizeof(*key));
+
+  if (stat(file_name, &st) != 0)
+    return false;
+
+  char full_name[PATH_MAX];
+  const char * name = realpath(file_name, full_name) ? full_name : file_name;
+
+  key->nameHash = fnv1a(name, strlen(name));
+  key->sourceSize = (uint64_t)st.st_size;
+  key->sourceMtimeNs = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+
+  return true;
+}
+
+
+void pcm_cache_key_for_memory(const void * data, size_t size, PcmCacheKey * key)
+{
+  memset(key, 0, sizeof(*key));
+  key->contentHash = fnv1a(data, size);
+  key->nameHash = fnv1a(&key->contentHash, sizeof(key->contentHash), fnv1a("memory", 6));
+  key->sourceSize = size;
+}
+
+
+const float * pcm_cache_load(const PcmCacheKey & key, int * length, float * advance, PcmCacheMapping * mapping)
+{
+  std::string dir;
+  memset(mapping, 0, sizeof(*mapping));
+
+  if (!get_cache_dir(dir))
+    return NULL;
+
+  int fd = open(get_blob_name(dir, key).c_str(), O_RDONLY);
+
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  void * data = MAP_FAILED;
+
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size > sizeof(PcmCacheHeader))
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  close(fd);
+
+  if (data == MAP_FAILED)
+    return NULL;
+
+  const PcmCacheHeader * header = (const PcmCacheHeader *)data;
+  bool valid = !memcmp(header->magic, "MPCM", 4) &&
+               header->version == PCM_CACHE_VERSION &&
+               header->freq == MMC_FREQ &&
+               header->length > 1 &&
+               !memcmp(&header->key, &key, sizeof(key)) &&
+               (size_t)st.st_size == sizeof(PcmCacheHeader) + sizeof(float) * 2 * (header->length + 1);
+
+  if (!valid)
+  {
+    munmap(data, (size_t)st.st_size);
+    return NULL;
+  }
+
+  mapping->data = data;
+  mapping->size = (size_t)st.st_size;
+  *length = header->length;
+  *advance = header->advance;
+
+  return (const float *)(header + 1);
+}
+
+
+void pcm_cache_store(const PcmCacheKey & key, const float * data, int length, float advance)
+{
+  std::string dir;
+
+  if (!get_cache_dir(dir))
+    return;
+
+  PcmCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "MPCM", 4);
+  header.version = PCM_CACHE_VERSION;
+  header.freq = MMC_FREQ;
+  header.length = length;
+  header.advance = advance;
+  header.key = key;
+
+  // write to a temporary file first, so a concurrent or interrupted run never sees a partial blob
+  std::string blob_name = get_blob_name(dir, key);
+  char tmp_name_suffix[32];
+  snprintf(tmp_name_suffix, sizeof(tmp_name_suffix), ".%d.tmp", (int)getpid());
+  std::string tmp_name = blob_name + tmp_name_suffix;
+  FILE * file = fopen(tmp_name.c_str(), "wb");
+
+  if (!file)
+    return;
+
+  bool success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                 fwrite(data, sizeof(float) * 2 * (length + 1), 1, file) == 1;
+  success = (fclose(file) == 0) && success;
+
+  if (!success || rename(tmp_name.c_str(), blob_name.c_str()) != 0)
+  {
+    printf("ERROR: cannot write PCM cache '%s'\n", blob_name.c_str());
+    unlink(tmp_name.c_str());
+  }
+}
+
+
+void pcm_cache_unmap(PcmCacheMapping * mapping)
+{
+  if (mapping->data)
+    munmap(mapping->data, mapping->size);
+
+  mapping->data = NULL;
+  mapping->size = 0;
+}
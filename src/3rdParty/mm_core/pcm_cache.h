@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Disk cache of decoded sounds in mixer format (interleaved stereo float at
+// MMC_FREQ + guard frame).
+// Blobs live in $MMC_PCM_CACHE_DIR, $XDG_CACHE_HOME/TetrisGL or ~/.cache/TetrisGL
+// and are mapped read-only. Empty MMC_PCM_CACHE_DIR disables the cache.
+
+struct PcmCacheKey
+{
+  uint64_t nameHash;     // cache file name
+  uint64_t sourceSize;
+  int64_t sourceMtimeNs; // files only
+  uint64_t contentHash;  // memory sources only
+};
+
+struct PcmCacheMapping
+{
+  void * data;
+  size_t size;
+};
+
+bool pcm_cache_key_for_file(const char * file_name, PcmCacheKey * key);
+void pcm_cache_key_for_memory(const void * data, size_t size, PcmCacheKey * key);
+
+// returns frames inside the mapping, 'length' excludes the guard frame
+const float * pcm_cache_load(const PcmCacheKey & key, int * length, float * advance, PcmCacheMapping * mapping);
+void pcm_cache_store(const PcmCacheKey & key, const float * data, int length, float advance);
+void pcm_cache_unmap(PcmCacheMapping * mapping);
@@ -0,0 +1,110 @@
+#include "resampler.h"
+
+#include <math.h>
+
+#define RESAMPLER_ZERO_CROSSINGS 16
+#define RESAMPLER_TABLE_STEPS 512 // kernel table entries per zero crossing
+#define RESAMPLER_KAISER_BETA 8.0
+#define RESAMPLER_CUTOFF 0.95 // of the lower Nyquist frequency
+
+
+static double bessel_i0(double x)
+{
+  double sum = 1.0;
+  double term = 1.0;
+
+  for (int k = 1; k < 32; k++)
+  {
+    term *= (x * 0.5 / k) * (x * 0.5 / k);
+    sum += term;
+  }
+
+  return sum;
+}
+
+
+// windowed sinc for |d| in [0, RESAMPLER_ZERO_CROSSINGS], sampled with one guard entry
+static std::vector<float> build_kernel_table()
+{
+  const int size = RESAMPLER_ZERO_CROSSINGS * RESAMPLER_TABLE_STEPS;
+  std::vector<float> table(size + 2, 0.0f);
+  double norm = 1.0 / bessel_i0(RESAMPLER_KAISER_BETA);
+
+  for (int i = 0; i <= size; i++)
+  {
+    double d = double(i) / RESAMPLER_TABLE_STEPS;
+    double r = d / RESAMPLER_ZERO_CROSSINGS;
+    double sinc = i ? sin(M_PI * d) / (M_PI * d) : 1.0;
+    table[i] = float(sinc * bessel_i0(RESAMPLER_KAISER_BETA * sqrt(1.0 - r * r)) * norm);
+  }
+
+  return table;
+}
+
+
+bool resample_to_stereo(const float * in, size_t frames, int channels, int in_hz, int out_hz,
+                        std::vector<float> & out)
+{
+  if (!in || !frames || channels <= 0 || in_hz <= 0 || out_hz <= 0)
+    return false;
+
+  const int rc = channels > 1 ? 1 : 0; // source channel of the right output channel
+
+  if (in_hz == out_hz)
+  {
+    out.resize(frames * 2);
+
+    for (size_t i = 0; i < frames; i++)
+    {
+      out[i * 2] = in[i * channels];
+      out[i * 2 + 1] = in[i * channels + rc];
+    }
+
+    return true;
+  }
+
+  static const std::vector<float> table = build_kernel_table();
+  const double ratio = double(in_hz) / out_hz;
+  // when downsampling the kernel is stretched to filter above the output Nyquist frequency
+  const double cutoff = RESAMPLER_CUTOFF * (ratio > 1.0 ? 1.0 / ratio : 1.0);
+  const double halfWidth = RESAMPLER_ZERO_CROSSINGS / cutoff;
+  const double tableScale = cutoff * RESAMPLER_TABLE_STEPS;
+  const size_t outFrames = size_t(ceil(double(frames) / ratio));
+
+  out.assign(outFrames * 2, 0.0f);
+
+  for (size_t j = 0; j < outFrames; j++)
+  {
+    double x = j * ratio;
+    long first = long(ceil(x - halfWidth));
+    long last = long(floor(x + halfWidth));
+
+    if (first < 0)
+      first = 0;
+
+    if (last >= long(frames))
+      last = long(frames) - 1;
+
+    double left = 0.0;
+    double right = 0.0;
+
+    for (long k = first; k <= last; k++)
+    {
+      double t = fabs(x - k) * tableScale;
+      size_t index = size_t(t);
+
+      if (index >= table.size() - 1)
+        continue;
+
+      double frac = t - index;
+      double w = table[index] + (table[index + 1] - table[index]) * frac;
+      left += in[k * channels] * w;
+      right += in[k * channels + rc] * w;
+    }
+
+    out[j * 2] = float(left * cutoff);
+    out[j * 2 + 1] = float(right * cutoff);
+  }
+
+  return true;
+}
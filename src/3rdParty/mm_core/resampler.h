@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Offline sample rate converter for sounds loaded into memory: Kaiser windowed sinc
+// (16 zero crossings, cutoff lowered when downsampling). Output is interleaved stereo,
+// mono sources are duplicated, sources with more channels keep the first two.
+// Returns false on invalid input.
+bool resample_to_stereo(const float * in, size_t frames, int channels, int in_hz, int out_hz,
+                        std::vector<float> & out);
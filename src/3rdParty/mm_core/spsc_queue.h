@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+// Wait-free single producer / single consumer queue with fixed capacity.
+// push() is called by one thread only, pop() by one (other) thread only.
+template <typename T, int SIZE>
+class SpscQueue
+{
+  static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+
+  T items[SIZE];
+  std::atomic<uint32_t> head; // next item to pop
+  std::atomic<uint32_t> tail; // next free slot
+
+public:
+  SpscQueue() : head(0), tail(0) {}
+
+  bool push(const T & item)
+  {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+
+    if (t - head.load(std::memory_order_acquire) >= (uint32_t)SIZE)
+      return false;
+
+    items[t & (SIZE - 1)] = item;
+    tail.store(t + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  bool pop(T & item)
+  {
+    uint32_t h = head.load(std::memory_order_relaxed);
+
+    if (h == tail.load(std::memory_order_acquire))
+      return false;
+
+    item = items[h & (SIZE - 1)];
+    head.store(h + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  bool empty() const
+  {
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+  }
+};
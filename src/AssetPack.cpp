@@ -0,0 +1,163 @@
+#include "static_headers.h"
+
+#include "AssetPack.h"
+#include "Crosy.h"
+#include "stb_image.h"
+
+const void * AssetPack::mapping = NULL;
+size_t AssetPack::mappingSize = 0;
+const AssetPack::Header * AssetPack::header = NULL;
+const AssetPack::Entry * AssetPack::entries = NULL;
+bool AssetPack::preferFiles = false;
+
+bool AssetPack::open(const char * fileName)
+{
+  assert(!mapping);
+  mapping = Crosy::mapFile(fileName, &mappingSize);
+
+  if (!mapping)
+    return false;
+
+  const Header * packHeader = (const Header *)mapping;
+  bool valid = mappingSize >= sizeof(Header) &&
+               !memcmp(packHeader->magic, "TPAK", 4) &&
+               packHeader->version == VERSION &&
+               mappingSize >= sizeof(Header) + (uint64_t)packHeader->entryCount * sizeof(Entry);
+
+  const Entry * packEntries = (const Entry *)(packHeader + 1);
+
+  for (uint32_t i = 0; valid && i < packHeader->entryCount; i++)
+  {
+    const Entry & entry = packEntries[i];
+    valid = entry.name[NAME_SIZE - 1] == '\0' &&
+            entry.offset <= mappingSize &&
+            entry.size <= mappingSize - entry.offset &&
+            (i == 0 || strcmp(packEntries[i - 1].name, entry.name) < 0);
+  }
+
+  if (!valid)
+  {
+    std::cout << "Invalid asset pack '" << fileName << "', using loose files\n";
+    Crosy::unmapFile(mapping, mappingSize);
+    mapping = NULL;
+    mappingSize = 0;
+    return false;
+  }
+
+  header = packHeader;
+  entries = packEntries;
+
+  return true;
+}
+
+
+void AssetPack::close()
+{
+  Crosy::unmapFile(mapping, mappingSize);
+  mapping = NULL;
+  mappingSize = 0;
+  header = NULL;
+  entries = NULL;
+}
+
+
+const AssetPack::Entry * AssetPack::find(const char * name)
+{
+  if (!header)
+    return NULL;
+
+  int first = 0;
+  int last = (int)header->entryCount - 1;
+
+  while (first <= last)
+  {
+    int middle = (first + last) / 2;
+    int cmp = strcmp(entries[middle].name, name);
+
+    if (cmp < 0)
+      first = middle + 1;
+    else if (cmp > 0)
+      last = middle - 1;
+    else
+      return entries + middle;
+  }
+
+  return NULL;
+}
+
+
+const void * AssetPack::getData(const Entry * entry)
+{
+  assert(entry && header);
+  return (const char *)mapping + entry->offset;
+}
+
+
+bool AssetPack::loadJson(const char * name, rapidjson::Document & doc)
+{
+  const Entry * entry = find(name);
+  std::string fileName = Crosy::getExePath() + name;
+  FILE * file = (!entry || preferFiles) ? fopen(fileName.c_str(), "rb") : NULL;
+
+  if (!file && entry)
+  {
+    rapidjson::MemoryStream mstream((const char *)getData(entry), (size_t)entry->size);
+    doc.ParseStream<rapidjson::kParseDefaultFlags, rapidjson::UTF8<> >(mstream);
+
+    return !doc.HasParseError();
+  }
+
+  assert(file);
+
+  if (!file)
+    return false;
+
+  const int bufSize = 16384;
+  char buf[bufSize];
+  rapidjson::FileReadStream frstream(file, buf, bufSize);
+  doc.ParseStream<rapidjson::FileReadStream>(frstream);
+  fclose(file);
+
+  return !doc.HasParseError();
+}
+
+
+const unsigned char * AssetPack::loadImage(const char * name, int channels, int * width, int * height)
+{
+  int fileChannels;
+
+  if (const Entry * entry = find(name))
+  {
+    if (entry->type != etImage)
+      return stbi_load_from_memory((const stbi_uc *)getData(entry), (int)entry->size,
+                                   width, height, &fileChannels, channels);
+
+    // raw pixels of a truncated or damaged pack would be read past the mapping, use the loose file
+    if ((int)entry->channels == channels &&
+        entry->size == (uint64_t)entry->width * entry->height * entry->channels)
+    {
+      *width = (int)entry->width;
+      *height = (int)entry->height;
+      return (const unsigned char *)getData(entry);
+    }
+
+    std::cout << "Asset pack image '" << name << "' has wrong size or channels, loading the loose file\n";
+  }
+
+  std::string fileName = Crosy::getExePath() + name;
+
+  return stbi_load(fileName.c_str(), width, height, &fileChannels, channels);
+}
+
+
+void AssetPack::freeImage(const unsigned char * image)
+{
+  if (!isMapped(image))
+    stbi_image_free(const_cast<unsigned char *>(image));
+}
+
+
+bool AssetPack::isMapped(const void * data)
+{
+  return mapping && data >= mapping && (const char *)data < (const char *)mapping + mappingSize;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// Read-only view of bin/assets.pak built by tools/AssetPacker.
+// The whole pack is mapped once; entries are located through a sorted index table
+// and point straight into the mapping. Every loader falls back to the loose file
+// under getExePath() when the pack is missing or does not contain the entry.
+class AssetPack
+{
+public:
+  enum EntryType
+  {
+    etRaw,   // file contents as is
+    etImage, // 8-bit pixels, width * height * channels
+    etPcm    // interleaved 32-bit float samples
+  };
+
+  static const uint32_t VERSION = 1;
+  static const uint32_t DATA_ALIGNMENT = 64;
+  static const int NAME_SIZE = 64;
+
+  struct Header
+  {
+    char magic[4];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t dataAlignment;
+  };
+
+  struct Entry
+  {
+    char name[NAME_SIZE];
+    uint32_t type;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;
+    uint32_t frequency;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  // loadJson reads loose files first when set, so edited layouts and palettes reload on F5
+  static bool preferFiles;
+
+  static bool open(const char * fileName);
+  static void close();
+  static bool isOpen() { return header != NULL; }
+  static const Entry * find(const char * name);
+  static const void * getData(const Entry * entry);
+  static bool loadJson(const char * name, rapidjson::Document & doc);
+  static const unsigned char * loadImage(const char * name, int channels, int * width, int * height);
+  static void freeImage(const unsigned char * image);
+
+private:
+  static const void * mapping;
+  static size_t mappingSize;
+  static const Header * header;
+  static const Entry * entries;
+
+  AssetPack();
+  ~AssetPack();
+
+  static bool isMapped(const void * data);
+};
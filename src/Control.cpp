@@ -3,15 +3,20 @@
 #include "Control.h"
 #include "Crosy.h"
 #include "Layout.h"
+#include "Profiler.h"
 #include "Time.h"
 
 Control::Control() :
+  activeKeyCount(0),
+  keyEventCount(0),
   mouseMoved(false),
   mouseDoubleClicked(false),
   fastDownBlocked(false)
 {
   repeatDelay = glm::max<uint64_t>(uint64_t(0.2 * PerfTime::freq), 1);
   repeatInterval = glm::max<uint64_t>(uint64_t(PerfTime::freq / 30), 1);
+  keyRepeats.reserve(KEY_COUNT);
+  keyTicks.reserve(maxKeyEvents);
 }
 
 
@@ -27,18 +32,13 @@ void Control::init()
 
 void Control::keyDown(Key key)
 {
-  KeyInternalState & internalKeyState = internalKeyStates[key];
-  internalKeyState.keyNextRepeatCounter = PerfTime::counter + repeatDelay;
-  internalKeyState.pressCount++;
-  internalKeyState.wasChanged = true;
+  keyEvent(key, true, Crosy::getPerformanceCounter());
 }
 
 
 void Control::keyUp(Key key)
 {
-  KeyInternalState & internalKeyState = internalKeyStates[key];
-  internalKeyState.keyNextRepeatCounter = 0;
-  internalKeyState.wasChanged = true;
+  keyEvent(key, false, Crosy::getPerformanceCounter());
 }
 
 
@@ -52,10 +52,7 @@ void Control::mouseMove(float x, float y)
 
 void Control::mouseDown(Key key)
 {
-  KeyInternalState & internalKeyState = internalKeyStates[key];
-  internalKeyState.keyNextRepeatCounter = PerfTime::counter + repeatDelay;
-  internalKeyState.pressCount++;
-  internalKeyState.wasChanged = true;
+  keyEvent(key, true, Crosy::getPerformanceCounter());
   const double doubleclickTime = 0.4;
   const float doubleclickRange = 0.005f;
   mouseDoubleClicked = (PerfTime::timer - lastLButtonClickTimer < doubleclickTime &&
@@ -71,9 +68,7 @@ void Control::mouseDown(Key key)
 
 void Control::mouseUp(Key key)
 {
-  KeyInternalState & internalKeyState = internalKeyStates[key];
-  internalKeyState.keyNextRepeatCounter = 0;
-  internalKeyState.wasChanged = true;
+  keyEvent(key, false, Crosy::getPerformanceCounter());
 }
 
 
@@ -94,6 +89,12 @@ void Control::mouseScroll(float dx, float dy)
 
 void Control::update()
 {
+  PROFILE_SCOPE("Control::update");
+  processKeyEvents();
+  // repeats are counted up to now rather than the frame start, all events have arrived by now
+  processKeyRepeats(Crosy::getPerformanceCounter());
+  std::stable_sort(keyTicks.begin(), keyTicks.end());
+
   switch (InterfaceLogic::state)
   {
     case InterfaceLogic::stHidden:
@@ -155,31 +156,131 @@ Control::KeyState Control::getKeyState(Key key) const
   keyState.isPressed = (keyInternalState.keyNextRepeatCounter > 0);
   keyState.wasChanged = keyInternalState.wasChanged;
   keyState.pressCount = keyInternalState.pressCount;
-  keyState.repeatCount = 
-    (keyState.isPressed && PerfTime::counter > keyInternalState.keyNextRepeatCounter) ? 
-    int((PerfTime::counter - keyInternalState.keyNextRepeatCounter) / repeatInterval + 1) : 0;
+  keyState.repeatCount = keyInternalState.repeatCount;
 
   return keyState;
 }
 
 
-void Control::updateInternalState()
+// 'counter' is the performance counter when the event happened
+void Control::keyEvent(Key key, bool isDown, uint64_t counter)
+{
+  assert(key >= FIRST_KEY && key < KEY_COUNT);
+
+  // more events than a frame normally gets, apply the queued ones right away
+  if (keyEventCount == maxKeyEvents)
+    processKeyEvents();
+
+  KeyEvent & event = keyEvents[keyEventCount++];
+  event.key = key;
+  event.isDown = isDown;
+  event.counter = counter;
+}
+
+
+void Control::processKeyEvents()
 {
-  for (Key key = FIRST_KEY; key < KEY_COUNT; key++)
+  for (int i = 0; i < keyEventCount; i++)
   {
-    KeyInternalState & keyInternalState = internalKeyStates[key];
-    bool isPressed = (keyInternalState.keyNextRepeatCounter > 0);
+    const KeyEvent & event = keyEvents[i];
+    KeyInternalState & keyInternalState = internalKeyStates[event.key];
 
-    if (isPressed && PerfTime::counter > keyInternalState.keyNextRepeatCounter)
+    if (event.isDown)
     {
-      keyInternalState.keyNextRepeatCounter +=
-        ((PerfTime::counter - keyInternalState.keyNextRepeatCounter) / repeatInterval + 1) * repeatInterval;
+      keyInternalState.keyNextRepeatCounter = event.counter + repeatDelay;
+      keyInternalState.pressCount++;
+
+      KeyRepeat repeat = { keyInternalState.keyNextRepeatCounter, event.key };
+      keyRepeats.push_back(repeat);
+      std::push_heap(keyRepeats.begin(), keyRepeats.end(), std::greater<KeyRepeat>());
     }
+    else
+      keyInternalState.keyNextRepeatCounter = 0;
 
+    keyInternalState.wasChanged = true;
+    addKeyTick(event.counter, event.key, event.isDown ? tickPress : tickRelease);
+    activateKey(event.key);
+  }
+
+  keyEventCount = 0;
+}
+
+
+void Control::processKeyRepeats(uint64_t counter)
+{
+  while (!keyRepeats.empty() && counter > keyRepeats.front().counter)
+  {
+    KeyRepeat repeat = keyRepeats.front();
+    std::pop_heap(keyRepeats.begin(), keyRepeats.end(), std::greater<KeyRepeat>());
+    keyRepeats.pop_back();
+
+    KeyInternalState & keyInternalState = internalKeyStates[repeat.key];
+
+    // key was released or pressed again since the deadline was scheduled
+    if (keyInternalState.keyNextRepeatCounter != repeat.counter)
+      continue;
+
+    // every repeat keeps its own time, so the game can apply it between gravity steps
+    while (counter > keyInternalState.keyNextRepeatCounter)
+    {
+      addKeyTick(keyInternalState.keyNextRepeatCounter, repeat.key, tickRepeat);
+      keyInternalState.keyNextRepeatCounter += repeatInterval;
+      keyInternalState.repeatCount++;
+    }
+
+    repeat.counter = keyInternalState.keyNextRepeatCounter;
+    keyRepeats.push_back(repeat);
+    std::push_heap(keyRepeats.begin(), keyRepeats.end(), std::greater<KeyRepeat>());
+    activateKey(repeat.key);
+  }
+}
+
+
+void Control::addKeyTick(uint64_t counter, Key key, KeyTickType type)
+{
+  KeyTick tick = { counter, key, type };
+  keyTicks.push_back(tick);
+}
+
+
+void Control::activateKey(Key key)
+{
+  KeyInternalState & keyInternalState = internalKeyStates[key];
+
+  if (keyInternalState.isActive)
+    return;
+
+  // keep key order, so simultaneous keys are handled in the same order as before
+  int i = activeKeyCount++;
+
+  for (; i > 0 && activeKeys[i - 1] > key; i--)
+    activeKeys[i] = activeKeys[i - 1];
+
+  activeKeys[i] = key;
+  keyInternalState.isActive = true;
+}
+
+
+void Control::updateInternalState()
+{
+  int keptKeyCount = 0;
+
+  for (int i = 0; i < activeKeyCount; i++)
+  {
+    const Key key = activeKeys[i];
+    KeyInternalState & keyInternalState = internalKeyStates[key];
     keyInternalState.pressCount = 0;
+    keyInternalState.repeatCount = 0;
     keyInternalState.wasChanged = false;
+
+    if (keyInternalState.keyNextRepeatCounter > 0)
+      activeKeys[keptKeyCount++] = key;
+    else
+      keyInternalState.isActive = false;
   }
 
+  activeKeyCount = keptKeyCount;
+  keyTicks.clear();
   mouseMoved = false;
   mouseDoubleClicked = false;
 }
@@ -196,93 +297,93 @@ void Control::updateGameControl()
   {
     GameLogic::menuButtonHighlighted = false;
 
-    if (LayoutObject * gameLayout = Layout::screen.getChild(loGame))
+    if (LayoutObject * mouseoverObject = Layout::getObjectFromPoint(loGame, mouseX, mouseY))
     {
-      if (LayoutObject * mouseoverObject = gameLayout->getObjectFromPoint(mouseX, mouseY))
+      if (mouseoverObject->id == loScoreBarMenuButton)
       {
-        if (mouseoverObject->id == loScoreBarMenuButton)
+        if (leftButtonState.isPressed)
         {
-          if (leftButtonState.isPressed)
-          {
-            GameLogic::pauseGame();
-            InterfaceLogic::showInGameMenu();
-          }
-          else
-            GameLogic::menuButtonHighlighted = true;
+          GameLogic::pauseGame();
+          InterfaceLogic::showInGameMenu();
         }
+        else
+          GameLogic::menuButtonHighlighted = true;
       }
     }
   }
   
-  for (Key key = FIRST_KEY; key < KEY_COUNT; key++)
+  // input is applied in the order and at the time it happened, gravity steps due in between
+  // are made first, so the result does not depend on the frame rate
+  for (size_t i = 0; i < keyTicks.size() && GameLogic::state == GameLogic::stPlaying; i++)
   {
-    KeyState keyState = getKeyState(key);
+    const KeyTick & tick = keyTicks[i];
+    GameLogic::advanceTime(double(tick.counter) / PerfTime::freq);
 
-    if (key == KB_ESCAPE && keyState.pressCount)
+    if (GameLogic::state != GameLogic::stPlaying)
+      break;
+
+    Binding::Action action = Binding::getKeyAction(tick.key);
+
+    if (tick.type == tickRelease)
     {
-      GameLogic::pauseGame();
-      InterfaceLogic::showInGameMenu();
+      if (action == Binding::fastDown)
+        fastDownBlocked = false;
     }
-    else
+    else if (tick.key == KB_ESCAPE)
     {
-      Binding::Action action = Binding::getKeyAction(key);
-
-      if (!GameLogic::haveFallingRows && action != Binding::doNothing)
+      if (tick.type == tickPress)
       {
-        if (keyState.pressCount || keyState.repeatCount)
-        {
-          for (int i = 0, cnt = keyState.pressCount + keyState.repeatCount; i < cnt; i++)
-          {
-            switch (action)
-            {
-              case Binding::moveLeft:
-                GameLogic::shiftCurrentFigureLeft();
-                break;
-              case Binding::moveRight:
-                GameLogic::shiftCurrentFigureRight();
-                break;
-              case Binding::rotateLeft:
-                GameLogic::rotateCurrentFigureLeft();
-                break;
-              case Binding::rotateRight:
-                GameLogic::rotateCurrentFigureRight();
-                break;
-              case Binding::fastDown:
-
-                if (!fastDownBlocked)
-                  fastDownBlocked = GameLogic::fastDownCurrentFigure();
-
-                break;
-
-              default: 
-                break;
-            }
-          }
-        }
-
-        if (keyState.pressCount)
-        {
-          for (int i = 0, cnt = keyState.pressCount; i < cnt; i++)
-          {
-            switch (action)
-            {
-              case Binding::dropDown:
-                GameLogic::dropCurrentFigure();
-                break;
-              case Binding::swapHold:
-                GameLogic::holdCurrentFigure();
-                break;
-              default:
-                break;
-            }
-          }
-        }
+        GameLogic::pauseGame();
+        InterfaceLogic::showInGameMenu();
       }
+    }
+    else if (!GameLogic::haveFallingRows && action != Binding::doNothing)
+    {
+      switch (action)
+      {
+        case Binding::moveLeft:
+          GameLogic::shiftCurrentFigureLeft();
+          break;
+        case Binding::moveRight:
+          GameLogic::shiftCurrentFigureRight();
+          break;
+        case Binding::rotateLeft:
+          GameLogic::rotateCurrentFigureLeft();
+          break;
+        case Binding::rotateRight:
+          GameLogic::rotateCurrentFigureRight();
+          break;
+        case Binding::fastDown:
 
-      if (action == Binding::fastDown && !keyState.isPressed)
-        fastDownBlocked = false;
+          if (!fastDownBlocked)
+            fastDownBlocked = GameLogic::fastDownCurrentFigure();
+
+          break;
+
+        case Binding::dropDown:
+
+          if (tick.type == tickPress)
+            GameLogic::dropCurrentFigure();
+
+          break;
+
+        case Binding::swapHold:
+
+          if (tick.type == tickPress)
+            GameLogic::holdCurrentFigure();
+
+          break;
+
+        default: 
+          break;
+      }
     }
   }
+
+  const Key fastDownKey = Binding::getActionKey(Binding::fastDown);
+
+  if (fastDownKey == KB_NONE || !getKeyState(fastDownKey).isPressed)
+    fastDownBlocked = false;
 }
 
 
@@ -293,7 +394,7 @@ void Control::updateMenuControl(MenuLogic & menu, LayoutObjectId layoutObjectId)
 
   KeyState leftButtonState = getKeyState(MOUSE_LEFT);
 
-  if (LayoutObject * mainMenuLayout = Layout::screen.getChild(layoutObjectId))
+  if (LayoutObject * mainMenuLayout = Layout::getObject(layoutObjectId))
   {
     int row, col;
 
@@ -307,8 +408,9 @@ void Control::updateMenuControl(MenuLogic & menu, LayoutObjectId layoutObjectId)
     }
   }
 
-  for (Key key = FIRST_KEY; key < KEY_COUNT; key++)
+  for (int i = 0; i < activeKeyCount; i++)
   {
+    const Key key = activeKeys[i];
     KeyState keyState = getKeyState(key);
 
     if (keyState.pressCount || keyState.repeatCount)
@@ -341,10 +443,10 @@ void Control::updateSettingsControl()
 {
   SettingsLogic & settingsLogic = InterfaceLogic::settingsLogic;
 
-  if (LayoutObject * settingsLayout = Layout::screen.getChild(loSettings))
+  if (Layout::getObject(loSettings))
   {
     KeyState mouseLButtonState = getKeyState(MOUSE_LEFT);
-    LayoutObject * mouseoverObject = settingsLayout->getObjectFromPoint(mouseX, mouseY);
+    LayoutObject * mouseoverObject = Layout::getObjectFromPoint(loSettings, mouseX, mouseY);
     bool rowHighlighed = (mouseoverObject != NULL);
     bool rowClicked = mouseLButtonState.isPressed && mouseLButtonState.wasChanged && mouseoverObject;
     bool rowDoubleclicked = rowClicked && mouseDoubleClicked;
@@ -424,11 +526,11 @@ void Control::updateSettingsControl()
     }
 
     if (rowDoubleclicked && mouseoverObject->id == loKeyBindingGrid)
-      settingsLogic.state = SettingsLogic::stKeyWaiting;
+      settingsLogic.waitForKey();
 
     if (draggedProgressBarId != loNone)
     {
-      LayoutObject * progressBarLayout = settingsLayout->getChildRecursive(draggedProgressBarId);
+      LayoutObject * progressBarLayout = Layout::getObject(draggedProgressBarId);
       const float progressBarLeft = progressBarLayout->getGlobalLeft() +
                                     Layout::settingsProgressBarBorder +
                                     Layout::settingsProgressBarInnerGap;
@@ -450,8 +552,9 @@ void Control::updateSettingsControl()
       }
     }
 
-    for (Key key = FIRST_KEY; key < KEY_COUNT; key++)
+    for (int i = 0; i < activeKeyCount; i++)
     {
+      const Key key = activeKeys[i];
       KeyState keyState = getKeyState(key);
 
       if (keyState.pressCount || keyState.repeatCount)
@@ -495,7 +598,7 @@ void Control::updateSettingsControl()
         case KB_KP_ENTER:
 
           if (settingsLogic.selectedControl == SettingsLogic::ctrlKeyBindTable)
-            settingsLogic.state = SettingsLogic::stKeyWaiting;
+            settingsLogic.waitForKey();
 
           break;
 
@@ -512,8 +615,9 @@ void Control::updateSettingsControl()
 
 void Control::updateSettingsKeyBindControl()
 {
-  for (Key key = FIRST_KEY; key < KEY_COUNT; key++)
+  for (int i = 0; i < activeKeyCount; i++)
   {
+    const Key key = activeKeys[i];
     KeyState keyState = getKeyState(key);
 
     if (keyState.isPressed && keyState.wasChanged)
@@ -532,10 +636,10 @@ void Control::updateLeaderboardControl()
 {
   LeaderboardLogic & leaderboardLogic = InterfaceLogic::leaderboardLogic;
 
-  if (LayoutObject * leaderboardLayout = Layout::screen.getChild(loLeaderboard))
+  if (Layout::getObject(loLeaderboard))
   {
     KeyState mouseLButtonState = getKeyState(MOUSE_LEFT);
-    LayoutObject * mouseoverObject = leaderboardLayout->getObjectFromPoint(mouseX, mouseY);
+    LayoutObject * mouseoverObject = Layout::getObjectFromPoint(loLeaderboard, mouseX, mouseY);
 
     leaderboardLogic.backButtonHighlighted = (mouseoverObject && 
                                               mouseoverObject->id == loLeaderboardBackButton && 
@@ -551,8 +655,9 @@ void Control::updateLeaderboardControl()
     }
   }
 
-  for (Key key = FIRST_KEY; key < KEY_COUNT; key++)
+  for (int i = 0; i < activeKeyCount; i++)
   {
+    const Key key = activeKeys[i];
     KeyState keyState = getKeyState(key);
 
     if (keyState.pressCount || keyState.repeatCount)
@@ -13,6 +13,7 @@ public:
 
   void keyDown(Key key);
   void keyUp(Key key);
+  void keyEvent(Key key, bool isDown, uint64_t counter);
   void mouseMove(float x, float y);
   void mouseDown(Key key);
   void mouseUp(Key key);
@@ -33,13 +34,56 @@ private:
   {
     uint64_t keyNextRepeatCounter; 
     int pressCount;
+    int repeatCount;
     bool wasChanged;
-    KeyInternalState() : keyNextRepeatCounter(0), pressCount(0), wasChanged(0) {};
+    bool isActive;
+    KeyInternalState() : keyNextRepeatCounter(0), pressCount(0), repeatCount(0), wasChanged(0), isActive(0) {};
+  };
+
+  struct KeyEvent
+  {
+    Key key;
+    bool isDown;
+    uint64_t counter; // performance counter when the window callback got the event
+  };
+
+  enum KeyTickType
+  {
+    tickPress,
+    tickRepeat,
+    tickRelease,
   };
 
+  struct KeyTick
+  {
+    uint64_t counter;
+    Key key;
+    KeyTickType type;
+    bool operator<(const KeyTick & other) const { return counter < other.counter; }
+  };
+
+  struct KeyRepeat
+  {
+    uint64_t counter;
+    Key key;
+    bool operator>(const KeyRepeat & other) const { return counter > other.counter; }
+  };
+
+  static const int maxKeyEvents = 64;
+
   uint64_t repeatDelay;
   uint64_t repeatInterval;
   KeyInternalState internalKeyStates[KEY_COUNT];
+  // keys pressed or changed during the frame, sorted by key; per frame work only touches these
+  Key activeKeys[KEY_COUNT];
+  int activeKeyCount;
+  // press and release events received from the window callbacks since the last update
+  KeyEvent keyEvents[maxKeyEvents];
+  int keyEventCount;
+  // min-heap of autorepeat deadlines, entries of released keys are skipped when they come up
+  std::vector<KeyRepeat> keyRepeats;
+  // presses, repeats and releases of the frame in time order, the game applies them one by one
+  std::vector<KeyTick> keyTicks;
   double lastLButtonClickTimer;
   glm::vec2 lastLButtonClickPos;
   float mouseX;
@@ -54,6 +98,10 @@ private:
   void updateSettingsControl();
   void updateSettingsKeyBindControl();
   void updateLeaderboardControl();
+  void processKeyEvents();
+  void processKeyRepeats(uint64_t counter);
+  void addKeyTick(uint64_t counter, Key key, KeyTickType type);
+  void activateKey(Key key);
   void updateInternalState();
   KeyState getKeyState(Key key) const;
 };
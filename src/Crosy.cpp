@@ -2,6 +2,16 @@
 #include <stdarg.h>
 #include <time.h>
 
+#ifdef _WIN32
+#include <mmsystem.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
 std::string Crosy::getExePath()
 {
 
@@ -129,6 +139,137 @@ void Crosy::sleep(unsigned int ms)
 }
 
 
+// absolute performance counter value, returns about the timer resolution late
+void Crosy::sleepUntil(uint64_t counter)
+{
+#ifdef _WIN32
+
+  const uint64_t freq = getPerformanceFrequency();
+
+  for (uint64_t now = getPerformanceCounter(); now < counter; now = getPerformanceCounter())
+  {
+    const uint64_t ms = (counter - now) * 1000 / freq;
+
+    if (!ms)
+      break;
+
+    Sleep(DWORD(ms));
+  }
+
+#elif __linux__
+
+  timespec ts;
+  ts.tv_sec = time_t(counter / 1000000000);
+  ts.tv_nsec = long(counter % 1000000000);
+
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+
+#else
+#error unknown platform
+#endif
+}
+
+
+// Sleep wakes on the scheduler tick, 15.6 ms by default on Windows; Linux sleeps are precise anyway
+void Crosy::beginFineSleep()
+{
+#ifdef _WIN32
+  timeBeginPeriod(1);
+#endif
+}
+
+
+void Crosy::endFineSleep()
+{
+#ifdef _WIN32
+  timeEndPeriod(1);
+#endif
+}
+
+
+const void * Crosy::mapFile(const char * fileName, size_t * size)
+{
+  *size = 0;
+
+#ifdef _WIN32
+
+  HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+
+  if (file == INVALID_HANDLE_VALUE)
+    return NULL;
+
+  LARGE_INTEGER fileSize = { 0, 0 };
+  void * data = NULL;
+
+  if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+  {
+    // the view stays valid after both handles are closed
+    if (HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL))
+    {
+      data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(mapping);
+    }
+  }
+
+  CloseHandle(file);
+
+  if (data)
+    *size = (size_t)fileSize.QuadPart;
+
+  return data;
+
+#elif __linux__
+
+  int fd = open(fileName, O_RDONLY);
+
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  void * data = NULL;
+
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+  {
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data == MAP_FAILED)
+      data = NULL;
+  }
+
+  close(fd);
+
+  if (data)
+    *size = (size_t)st.st_size;
+
+  return data;
+
+#else
+#error unknown platform
+#endif
+}
+
+
+void Crosy::unmapFile(const void * data, size_t size)
+{
+  if (!data)
+    return;
+
+#ifdef _WIN32
+
+  UnmapViewOfFile(data);
+
+#elif __linux__
+
+  munmap(const_cast<void *>(data), size);
+
+#else
+#error unknown platform
+#endif
+}
+
+
 void Crosy::snprintf(char * buf, size_t size, const char * format, ...)
 {
   va_list args;
@@ -28,5 +28,11 @@ namespace Crosy
   uint64_t getPerformanceFrequency();
   uint64_t getSystemTime();
   void sleep(unsigned int timeMs);
+  void sleepUntil(uint64_t counter);
+  // 1 ms scheduler resolution for sleeps until the matching end call, Windows only
+  void beginFineSleep();
+  void endFineSleep();
+  const void * mapFile(const char * fileName, size_t * size);
+  void unmapFile(const void * data, size_t size);
   void snprintf(char * buf, size_t size, const char * format, ...);
 }
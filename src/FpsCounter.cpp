@@ -2,9 +2,13 @@
 
 #include "FpsCounter.h"
 #include "Crosy.h"
+#include "GameEvents.h"
+#include "GameLogic.h"
 #include "Time.h"
 #include <stdlib.h>
 
+const float FpsCounter::minBucketTime = 0.000125f;
+
 FpsCounter::FpsCounter()
 {
 }
@@ -17,12 +21,24 @@ FpsCounter::~FpsCounter()
 
 void FpsCounter::init()
 {
-  enabled = (getenv("FPS_COUNTER") != NULL);
+  titleEnabled = (getenv("FPS_COUNTER") != NULL);
+  graphEnabled = (getenv("FRAME_GRAPH") != NULL);
+  const char * statsFileNameValue = getenv("FRAME_STATS");
+  statsFileName = statsFileNameValue ? statsFileNameValue : "";
+  enabled = titleEnabled || graphEnabled || !statsFileName.empty();
   cnt = 0;
   fps = 0.0f;
   freq = Crosy::getPerformanceFrequency();
   lastIntervalCounter = Crosy::getPerformanceCounter();
+  lastFrameCounter = 0;
   maxFrameTime = 0.0f;
+  frameTimeCounter = 0;
+  buf[0] = 0;
+  budget = 1.0f / 60.0f;
+  stats.clear();
+  sessions.clear();
+  memset(recentFrameTimes, 0, sizeof(recentFrameTimes));
+  recentHead = 0;
 }
 
 
@@ -30,13 +46,20 @@ char * FpsCounter::count(float interval)
 {
   cnt++;
 
+  for (int i = 0, eventCount = GameEvents::getCount(); i < eventCount; i++)
+  {
+    const GameEvents::Event & event = GameEvents::get(i);
+
+    // the first countdown event of a game
+    if (event.type == GameEvents::evCountdown && event.value == GameLogic::countdownTime)
+      newSession();
+  }
+
   if (freq)
   {
     bool redraw = false;
     uint64_t counter = Crosy::getPerformanceCounter();
     float intervalTime = float(double(counter - lastIntervalCounter) / double(freq));
-    float frameTime = PerfTime::getCurrentTimerDelta();// float(double(counter - lastFrameCounter) / double(freq));
-    lastFrameCounter = counter;
 
     if (intervalTime > interval)
     {
@@ -46,21 +69,207 @@ char * FpsCounter::count(float interval)
       cnt = 0;
     }
 
-    if (frameTime  > maxFrameTime)
+    if (lastFrameCounter)
     {
-      maxFrameTime = frameTime;
-      frameTimeCounter = counter;
-      redraw = true;
-    }
-    else if (counter - frameTimeCounter > uint64_t(interval * freq))
-    {
-      maxFrameTime = 0.0f;
-      frameTimeCounter = counter;
+      // the whole interval between frames, with swap and waits, is what the screen shows
+      const float frameTime = float(double(counter - lastFrameCounter) / double(freq));
+      stats.add(frameTime, budget);
+      recentFrameTimes[recentHead] = frameTime;
+      recentHead = (recentHead + 1) % recentCount;
+
+      if (frameTime > maxFrameTime)
+      {
+        maxFrameTime = frameTime;
+        frameTimeCounter = counter;
+        redraw = true;
+      }
+      else if (counter - frameTimeCounter > uint64_t(interval * freq))
+      {
+        maxFrameTime = 0.0f;
+        frameTimeCounter = counter;
+      }
     }
 
+    lastFrameCounter = counter;
+
     if (redraw)
-      Crosy::snprintf(buf, bufSize, "Fps: %.3f MaxFrameTime: %.3fms", fps, maxFrameTime * 1000);
+      Crosy::snprintf(buf, bufSize, "Fps: %.3f MaxFrameTime: %.3fms p99: %.3fms", fps, maxFrameTime * 1000,
+                      stats.getPercentile(0.99f) * 1000);
   }
 
   return buf;
 }
+
+
+void FpsCounter::newSession()
+{
+  if (stats.frameCount)
+    sessions.push_back(stats);
+
+  stats.clear();
+}
+
+
+void FpsCounter::quit()
+{
+  if (!enabled)
+    return;
+
+  newSession();
+
+  if (statsFileName.empty())
+    return;
+
+  FILE * file = fopen(statsFileName.c_str(), "wb");
+
+  if (!file)
+  {
+    std::cout << "Frame stats: cannot create " << statsFileName << "\n";
+    return;
+  }
+
+  const size_t extPos = statsFileName.rfind('.');
+  const bool json = (extPos != std::string::npos && statsFileName.compare(extPos, std::string::npos, ".json") == 0);
+  const bool saved = json ? saveJson(file) : saveCsv(file);
+  fclose(file);
+
+  if (!saved)
+    std::cout << "Frame stats: error writing " << statsFileName << "\n";
+}
+
+
+bool FpsCounter::saveCsv(FILE * file) const
+{
+  bool result = fprintf(file, "session,frames,mean_ms,p50_ms,p95_ms,p99_ms,p99_9_ms,max_ms,"
+                              "over_budget,over_double_budget,budget_ms\n") > 0;
+
+  for (int i = 0; i < (int)sessions.size(); i++)
+  {
+    const Stats & session = sessions[i];
+    result = result && fprintf(file, "%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%d,%d,%.3f\n", i + 1,
+                               session.frameCount, session.frameTimeSum * 1000.0 / session.frameCount,
+                               session.getPercentile(0.5f) * 1000, session.getPercentile(0.95f) * 1000,
+                               session.getPercentile(0.99f) * 1000, session.getPercentile(0.999f) * 1000,
+                               session.maxFrameTime * 1000, session.overBudgetCount,
+                               session.overDoubleBudgetCount, budget * 1000) > 0;
+  }
+
+  return result;
+}
+
+
+bool FpsCounter::saveJson(FILE * file) const
+{
+  rapidjson::StringBuffer buffer;
+  rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+
+  writer.StartObject();
+  writer.String("BudgetMs");
+  writer.Double(budget * 1000);
+  writer.String("Sessions");
+  writer.StartArray();
+
+  for (const Stats & session : sessions)
+  {
+    writer.StartObject();
+    writer.String("Frames");
+    writer.Int(session.frameCount);
+    writer.String("MeanMs");
+    writer.Double(session.frameTimeSum * 1000.0 / session.frameCount);
+    writer.String("P50Ms");
+    writer.Double(session.getPercentile(0.5f) * 1000);
+    writer.String("P95Ms");
+    writer.Double(session.getPercentile(0.95f) * 1000);
+    writer.String("P99Ms");
+    writer.Double(session.getPercentile(0.99f) * 1000);
+    writer.String("P99_9Ms");
+    writer.Double(session.getPercentile(0.999f) * 1000);
+    writer.String("MaxMs");
+    writer.Double(session.maxFrameTime * 1000);
+    writer.String("OverBudget");
+    writer.Int(session.overBudgetCount);
+    writer.String("OverDoubleBudget");
+    writer.Int(session.overDoubleBudgetCount);
+
+    // non-empty buckets only, each with its upper bound
+    writer.String("Histogram");
+    writer.StartArray();
+
+    for (int i = 0; i < bucketCount; i++)
+      if (session.buckets[i])
+      {
+        writer.StartObject();
+        writer.String("UpToMs");
+        writer.Double(i < bucketCount - 1 ? getBucketUpperTime(i) * 1000 : session.maxFrameTime * 1000);
+        writer.String("Count");
+        writer.Int(session.buckets[i]);
+        writer.EndObject();
+      }
+
+    writer.EndArray();
+    writer.EndObject();
+  }
+
+  writer.EndArray();
+  writer.EndObject();
+
+  return fwrite(buffer.GetString(), 1, buffer.GetSize(), file) == buffer.GetSize();
+}
+
+
+int FpsCounter::getBucket(float frameTime)
+{
+  if (frameTime <= minBucketTime)
+    return 0;
+
+  return glm::min(int(log2f(frameTime / minBucketTime) * bucketsPerOctave), int(bucketCount) - 1);
+}
+
+
+float FpsCounter::getBucketUpperTime(int bucket)
+{
+  return minBucketTime * exp2f(float(bucket + 1) / bucketsPerOctave);
+}
+
+
+void FpsCounter::Stats::clear()
+{
+  frameCount = 0;
+  overBudgetCount = 0;
+  overDoubleBudgetCount = 0;
+  frameTimeSum = 0.0;
+  maxFrameTime = 0.0f;
+  memset(buckets, 0, sizeof(buckets));
+}
+
+
+void FpsCounter::Stats::add(float frameTime, float budget)
+{
+  frameCount++;
+  frameTimeSum += frameTime;
+  maxFrameTime = glm::max(maxFrameTime, frameTime);
+  buckets[getBucket(frameTime)]++;
+
+  if (frameTime > 1.5f * budget)
+    overBudgetCount++;
+
+  if (frameTime > 2.5f * budget)
+    overDoubleBudgetCount++;
+}
+
+
+// upper bound of the bucket holding the percentile, 9% resolution
+float FpsCounter::Stats::getPercentile(float fraction) const
+{
+  const int rank = glm::max(int(ceilf(fraction * frameCount)), 1);
+
+  for (int i = 0, sum = 0; i < bucketCount; i++)
+  {
+    sum += buckets[i];
+
+    if (sum >= rank)
+      return glm::min(getBucketUpperTime(i), maxFrameTime);
+  }
+
+  return maxFrameTime;
+}
@@ -1,7 +1,37 @@
 #pragma once
 
+// Frame rate in the window title (FPS_COUNTER environment variable) and frame time statistics.
+// Frame times (the interval between count calls) go into a log-scale histogram per session;
+// a session lasts from one new game to the next. FRAME_STATS=<file.csv|file.json> writes
+// the statistics of every session on exit, FRAME_GRAPH draws the last frames on the screen.
 class FpsCounter
 {
+public:
+  enum { bucketsPerOctave = 8 };
+  // 1/8 ms .. 512 ms, longer frames go to the last bucket
+  enum { bucketCount = 12 * bucketsPerOctave };
+  enum { recentCount = 128 };
+
+  static const float minBucketTime;
+
+  struct Stats
+  {
+    int frameCount;
+    // frames over 1.5 and 2.5 budgets, at least one and two frame slots were missed
+    int overBudgetCount;
+    int overDoubleBudgetCount;
+    double frameTimeSum;
+    float maxFrameTime;
+    int buckets[bucketCount];
+
+    void clear();
+    void add(float frameTime, float budget);
+    float getPercentile(float fraction) const;
+  };
+
+  static int getBucket(float frameTime);
+  static float getBucketUpperTime(int bucket);
+
 private:
   int cnt;
   float fps;
@@ -12,14 +42,33 @@ private:
   uint64_t frameTimeCounter;
   enum { bufSize = 256 };
   char buf[bufSize];
+  float budget;
+  Stats stats;
+  std::vector<Stats> sessions;
+  float recentFrameTimes[recentCount];
+  int recentHead;
+  std::string statsFileName;
+
+  void newSession();
+  bool saveCsv(FILE * file) const;
+  bool saveJson(FILE * file) const;
 
 public:
   bool enabled;
+  bool titleEnabled;
+  bool graphEnabled;
 
   FpsCounter();
   ~FpsCounter();
 
   void init();
+  void quit();
+  void setBudget(float frameTime) { budget = frameTime; }
+  float getBudget() const { return budget; }
   char * count(float interval);
+  // the next count does not take a frame time, for frames after a wait
+  void restart() { lastFrameCounter = 0; }
+  const Stats & getStats() const { return stats; }
+  // 0 is the last frame
+  float getRecentFrameTime(int age) const { return recentFrameTimes[(recentHead - 1 - age + 2 * recentCount) % recentCount]; }
 };
-
@@ -0,0 +1,133 @@
+#include "static_headers.h"
+
+#include "FramePacer.h"
+#include "Crosy.h"
+#include "Profiler.h"
+#include <stdlib.h>
+
+FramePacer::FramePacer() :
+  freq(0),
+  period(0),
+  deadline(0),
+  spinMargin(0),
+  maxSpinMargin(0),
+  frameCount(0),
+  lateFrameCount(0),
+  sleepCount(0),
+  wakeErrorSum(0.0),
+  wakeErrorMax(0.0),
+  overshootSum(0.0),
+  overshootMax(0.0),
+  spinTimeSum(0.0),
+  fineSleep(false),
+  targetFps(100.0f),
+  statsEnabled(false)
+{
+}
+
+
+FramePacer::~FramePacer()
+{
+  if (fineSleep)
+    Crosy::endFineSleep();
+}
+
+
+void FramePacer::init()
+{
+  const char * targetFpsValue = getenv("TARGET_FPS");
+
+  if (targetFpsValue)
+    targetFps = glm::max(float(atof(targetFpsValue)), 0.0f);
+
+  statsEnabled = (getenv("FRAME_PACER_STATS") != NULL);
+  freq = Crosy::getPerformanceFrequency();
+  period = targetFps > 0.0f ? uint64_t(freq / targetFps) : 0;
+  // start with 1 ms like the timer resolution of a usual desktop, the wait adjusts it
+  spinMargin = freq / 1000;
+  maxSpinMargin = freq / 250;
+  deadline = Crosy::getPerformanceCounter();
+
+  // the spin margin follows the sleep overshoot, with a coarse timer it would spin most of the frame
+  if (period && !fineSleep)
+  {
+    Crosy::beginFineSleep();
+    fineSleep = true;
+  }
+}
+
+
+void FramePacer::wait()
+{
+  if (!period)
+    return;
+
+  PROFILE_SCOPE("FramePacer::wait");
+  uint64_t now = Crosy::getPerformanceCounter();
+
+  if (!deadline)
+  {
+    deadline = now;
+    return;
+  }
+
+  deadline += period;
+
+  // a slow frame (or vSync at a lower rate) moves the schedule instead of making later frames short
+  if (deadline <= now)
+  {
+    deadline = now;
+    lateFrameCount++;
+    return;
+  }
+
+  if (deadline - now > spinMargin)
+  {
+    const uint64_t sleepTarget = deadline - spinMargin;
+    Crosy::sleepUntil(sleepTarget);
+    now = Crosy::getPerformanceCounter();
+    const uint64_t overshoot = now > sleepTarget ? now - sleepTarget : 0;
+
+    // grow fast on late wake-ups and shrink slowly when sleeps get precise, so the margin
+    // settles near the high percentiles of the overshoot; rare outliers do not make every frame spin
+    if (overshoot > spinMargin)
+      spinMargin += (glm::min(overshoot, maxSpinMargin) - spinMargin) / 4;
+    else
+      spinMargin -= (spinMargin - overshoot) / 64;
+
+    sleepCount++;
+    overshootSum += toUsec(overshoot);
+    overshootMax = glm::max(overshootMax, toUsec(overshoot));
+  }
+
+  const uint64_t spinStart = now;
+
+  while (now < deadline)
+    now = Crosy::getPerformanceCounter();
+
+  const double wakeError = toUsec(now - deadline);
+  wakeErrorSum += wakeError;
+  wakeErrorMax = glm::max(wakeErrorMax, wakeError);
+  spinTimeSum += toUsec(now - spinStart);
+  frameCount++;
+}
+
+
+// the next frame goes out at once and starts a new schedule, for frames after an idle wait
+void FramePacer::restart()
+{
+  deadline = 0;
+}
+
+
+void FramePacer::print() const
+{
+  if (!statsEnabled || !period)
+    return;
+
+  const int count = glm::max(frameCount, 1);
+  printf("Frame pacer, target %.1f fps: %d waits, %d late frames\n", targetFps, frameCount, lateFrameCount);
+  printf("  wake-up error: mean %.1f usec, max %.1f usec\n", wakeErrorSum / count, wakeErrorMax);
+  printf("  sleep overshoot: mean %.1f usec, max %.1f usec, spin: mean %.1f usec, margin %.1f usec\n",
+         overshootSum / glm::max(sleepCount, 1), overshootMax, spinTimeSum / count, toUsec(spinMargin));
+}
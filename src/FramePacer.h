@@ -0,0 +1,42 @@
+#pragma once
+
+// Frame rate limiter. Frames are due at fixed deadlines of 1 / targetFps; the wait sleeps
+// to an absolute time a calibrated margin before the deadline and spins the rest, the
+// margin follows the observed sleep overshoot. TARGET_FPS environment variable sets the
+// target (100 by default, 0 disables pacing), FRAME_PACER_STATS prints wake-up statistics
+// on exit.
+class FramePacer
+{
+private:
+  uint64_t freq;
+  uint64_t period;
+  uint64_t deadline;
+  uint64_t spinMargin;
+  uint64_t maxSpinMargin;
+
+  int frameCount;
+  int lateFrameCount;
+  int sleepCount;
+  double wakeErrorSum;
+  double wakeErrorMax;
+  double overshootSum;
+  double overshootMax;
+  double spinTimeSum;
+  bool fineSleep;
+
+  double toUsec(uint64_t counterDelta) const { return double(counterDelta) * 1000000.0 / freq; }
+
+public:
+  float targetFps;
+  bool statsEnabled;
+
+  FramePacer();
+  ~FramePacer();
+
+  void init();
+  void wait();
+  void restart();
+  // seconds, 0 when pacing is off
+  double getPeriod() const { return freq ? double(period) / freq : 0.0; }
+  void print() const;
+};
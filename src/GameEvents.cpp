@@ -0,0 +1,48 @@
+#include "static_headers.h"
+
+#include "GameEvents.h"
+#include "Time.h"
+
+GameEvents::Event GameEvents::events[capacity];
+unsigned int GameEvents::frameBegin = 0;
+unsigned int GameEvents::head = 0;
+unsigned int GameEvents::lostCount = 0;
+double GameEvents::eventTime = 0.0;
+
+void GameEvents::beginFrame()
+{
+  frameBegin = head;
+  eventTime = PerfTime::timer;
+}
+
+
+void GameEvents::push(Type type, int value)
+{
+  if (head - frameBegin >= (unsigned int)capacity)
+  {
+    lostCount++;
+    return;
+  }
+
+  Event & event = events[head % capacity];
+  event.type = type;
+  event.value = value;
+  event.time = eventTime;
+  head++;
+}
+
+
+int GameEvents::getCount()
+{
+  return int(head - frameBegin);
+}
+
+
+// 0 is the first event of the frame
+const GameEvents::Event & GameEvents::get(int index)
+{
+  assert(index >= 0);
+  assert(index < getCount());
+
+  return events[(frameBegin + index) % capacity];
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+// Events of one frame in the order they happened. Logic pushes them when the action
+// takes effect, subscribers (sound, effects, stats) read them after Logic::update.
+// Fixed ring, nothing is allocated while playing.
+class GameEvents
+{
+public:
+  enum Type
+  {
+    evShiftLeft,
+    evShiftRight,
+    evRotateLeft,
+    evRotateRight,
+    evHold,
+    evFastDown,
+    evDrop,         // value: rows the figure has fallen
+    evLevelUp,      // value: new level, pushed right before evRowsDeleted
+    evRowsDeleted,  // value: deleted rows count
+    evCountdown,    // value: seconds left
+    evMenuShowing,
+    evMenuHiding,
+    evKeyWaiting,
+    evSoundVolume,
+    evMusicVolume,
+    TYPE_COUNT
+  };
+
+  struct Event
+  {
+    Type type;
+    int value;
+    double time; // PerfTime::timer units, game time of the input or step that caused the event
+  };
+
+  static const int capacity = 256;
+
+  static void beginFrame();
+  // time of the events pushed next; the frame start until game logic sets the time of a tick
+  static void setTime(double time) { eventTime = time; }
+  static void push(Type type, int value = 0);
+  static int getCount();
+  static const Event & get(int index);
+  static unsigned int getLostCount() { return lostCount; }
+
+private:
+  static Event events[capacity];
+  static unsigned int frameBegin;
+  static unsigned int head;
+  static unsigned int lostCount;
+  static double eventTime;
+
+  GameEvents();
+  ~GameEvents();
+};
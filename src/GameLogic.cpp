@@ -1,6 +1,7 @@
 #include "static_headers.h"
 
 #include "GameLogic.h"
+#include "GameEvents.h"
 #include "Crosy.h"
 #include "Time.h"
 
@@ -14,8 +15,6 @@ bool GameLogic::haveHold = false;
 bool GameLogic::haveFallingRows = false;
 double GameLogic::rowsDeleteTimer = -1.0;
 bool GameLogic::menuButtonHighlighted = false;
-unsigned int GameLogic::fastDownCounter = 0;
-unsigned int GameLogic::dropTrailCounter = 0;
 float GameLogic::countdownTimeLeft = 0.0f;
 float GameLogic::gameOverTimeLeft = 0.0f;
 float GameLogic::rowsDeletionEffectTime = 0.8f;
@@ -24,6 +23,7 @@ Figure GameLogic::holdFigure;
 Figure GameLogic::curFigure;
 const int GameLogic::maxLevel = 20;
 double GameLogic::lastStepTimer = -1.0f;
+double GameLogic::gameTimer = -1.0;
 bool  GameLogic::justHolded = false;
 Field GameLogic::field;
 std::vector<Figure> GameLogic::nextFigures;
@@ -94,6 +94,7 @@ GameLogic::Result GameLogic::initUpdate()
   resetGame();
   state = stCountdown;
   countdownTimeLeft = countdownTime + 0.99f;
+  GameEvents::push(GameEvents::evCountdown, countdownTime);
 
   return resNone;
 }
@@ -101,13 +102,41 @@ GameLogic::Result GameLogic::initUpdate()
 
 GameLogic::Result GameLogic::playingUpdate()
 {
-  const float stepTime = getStepTime();
+  advanceTime(PerfTime::timer);
+  proceedFallingRows();
+  updateEffects();
 
-  if (haveFallingRows)
-    lastStepTimer = PerfTime::timer;
-  else if (PerfTime::timer > lastStepTimer + stepTime)
+  return resNone;
+}
+
+
+// Moves the game clock forward to 'time' (PerfTime::timer units), making the gravity steps
+// due on the way at their own times. Control calls it with the timestamp of every input
+// action before applying it, so steps and actions interleave the same way at any FPS.
+void GameLogic::advanceTime(double time)
+{
+  // at the top levels steps would otherwise come faster than any frame
+  const double minStepTime = 1.0 / 60.0;
+  // after a stall (window drag, debugger) the figure falls one row instead of many
+  const double maxCatchUpTime = 0.25;
+
+  if (time <= gameTimer)
+  {
+    GameEvents::setTime(gameTimer);
+    return;
+  }
+
+  gameTimer = time;
+  const double stepTime = glm::max<double>(getStepTime(), minStepTime);
+
+  if (gameTimer - lastStepTimer > maxCatchUpTime)
+    lastStepTimer = gameTimer - stepTime;
+
+  while (state == stPlaying && !haveFallingRows && gameTimer > lastStepTimer + stepTime)
   {
-    // falling speed may be limited on extremely low FPS
+    lastStepTimer += stepTime;
+    GameEvents::setTime(lastStepTimer);
+
     if (check(curFigure, curFigureX, curFigureY + 1))
       curFigureY++;
     else
@@ -116,24 +145,28 @@ GameLogic::Result GameLogic::playingUpdate()
       checkFieldRows();
       shiftFigureConveyor();
     }
-
-    lastStepTimer = PerfTime::timer;
   }
 
-  proceedFallingRows();
-  updateEffects();
+  if (haveFallingRows)
+    lastStepTimer = gameTimer;
 
-  return resNone;
+  // the action Control applies next happened now
+  GameEvents::setTime(gameTimer);
 }
 
 
 GameLogic::Result GameLogic::countdownUpdate()
 {
+  int secondsLeft = (int)countdownTimeLeft;
   countdownTimeLeft -= PerfTime::timerDelta;
 
+  if ((int)countdownTimeLeft != secondsLeft)
+    GameEvents::push(GameEvents::evCountdown, (int)countdownTimeLeft);
+
   if (countdownTimeLeft < 0.0f)
   {
-    lastStepTimer = PerfTime::timer;
+    gameTimer = PerfTime::timer;
+    lastStepTimer = gameTimer;
     state = stPlaying;
   }
 
@@ -272,8 +305,9 @@ void GameLogic::holdCurrentFigure()
         Figure::Type curFigureType = curFigure.type;
         curFigure = holdFigure;
         holdFigure.build(curFigureType);
-        lastStepTimer = PerfTime::timer;
+        lastStepTimer = gameTimer;
         justHolded = true;
+        GameEvents::push(GameEvents::evHold);
       }
     }
     else
@@ -283,8 +317,9 @@ void GameLogic::holdCurrentFigure()
         holdFigure.build(curFigure.type);
         shiftFigureConveyor();
         haveHold = true;
-        lastStepTimer = PerfTime::timer;
+        lastStepTimer = gameTimer;
         justHolded = true;
+        GameEvents::push(GameEvents::evHold);
       }
     }
   }
@@ -305,8 +340,8 @@ bool GameLogic::fastDownCurrentFigure()
     result = true;
   }
 
-  lastStepTimer = PerfTime::timer;
-  fastDownCounter++;
+  lastStepTimer = gameTimer;
+  GameEvents::push(GameEvents::evFastDown);
 
   return result;
 }
@@ -325,6 +360,7 @@ void GameLogic::dropCurrentFigure()
   if (y1 - y0 > 0)
   {
     curScore += (y1 - y0) / 2;
+    GameEvents::push(GameEvents::evDrop, y1 - y0);
 
     for (int x = 0; x < dim; x++)
       for (int y = 0; y < dim; y++)
@@ -335,7 +371,7 @@ void GameLogic::dropCurrentFigure()
         }
   }
 
-  lastStepTimer = PerfTime::timer;
+  lastStepTimer = gameTimer;
   storeCurFigureIntoField();
   checkFieldRows();
   shiftFigureConveyor();
@@ -347,7 +383,9 @@ void GameLogic::rotateCurrentFigureLeft()
   Figure savedFigure = curFigure;
   curFigure.rotateLeft();
 
-  if (!fit(curFigure, curFigureX, curFigureY, &curFigureX))
+  if (fit(curFigure, curFigureX, curFigureY, &curFigureX))
+    GameEvents::push(GameEvents::evRotateLeft);
+  else
     curFigure = savedFigure;
 }
 
@@ -357,7 +395,9 @@ void GameLogic::rotateCurrentFigureRight()
   Figure savedFigure = curFigure;
   curFigure.rotateRight();
 
-  if (!fit(curFigure, curFigureX, curFigureY, &curFigureX))
+  if (fit(curFigure, curFigureX, curFigureY, &curFigureX))
+    GameEvents::push(GameEvents::evRotateRight);
+  else
     curFigure = savedFigure;
 }
 
@@ -365,14 +405,20 @@ void GameLogic::rotateCurrentFigureRight()
 void GameLogic::shiftCurrentFigureLeft()
 {
   if (check(curFigure, curFigureX - 1, curFigureY))
+  {
     curFigureX--;
+    GameEvents::push(GameEvents::evShiftLeft);
+  }
 }
 
 
 void GameLogic::shiftCurrentFigureRight()
 {
   if (check(curFigure, curFigureX + 1, curFigureY))
+  {
     curFigureX++;
+    GameEvents::push(GameEvents::evShiftRight);
+  }
 }
 
 
@@ -415,7 +461,10 @@ void GameLogic::checkFieldRows()
     {
       curLevel++;
       curGoal = curLevel * 5;
+      GameEvents::push(GameEvents::evLevelUp, curLevel);
     }
+
+    GameEvents::push(GameEvents::evRowsDeleted, elevation);
   }
 }
 
@@ -451,7 +500,6 @@ void GameLogic::addDropTrail(int x, int y, int height, Cell::Color color)
   {
     DropTrail & dropTrail = dropTrails[dropTrailsHead];
     dropTrail.set(x, y, height, color);
-    dropTrailCounter++;
     dropTrailsHead = newHead;
   }
 }
@@ -55,8 +55,6 @@ public:
   static bool haveFallingRows;
   static double rowsDeleteTimer;
   static bool menuButtonHighlighted;
-  static unsigned int fastDownCounter;
-  static unsigned int dropTrailCounter;
   static const int countdownTime = 3;
   static float countdownTimeLeft;
   static const int gameOverTime = 3;
@@ -69,6 +67,7 @@ public:
   static int dropTrailsTail;
 
   static Result update();
+  static void advanceTime(double time);
   static void holdCurrentFigure();
   static bool fastDownCurrentFigure();
   static void dropCurrentFigure();
@@ -97,6 +96,7 @@ public:
 private:
   static const int maxLevel;
   static double lastStepTimer;
+  static double gameTimer;
   static bool justHolded;
   static std::vector<int> rowElevation;
   static std::vector<float> rowCurrentElevation;
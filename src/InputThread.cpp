@@ -0,0 +1,418 @@
+#include "static_headers.h"
+
+#include "InputThread.h"
+#include "Crosy.h"
+
+#ifdef __linux__
+#define GLFW_EXPOSE_NATIVE_X11
+#define GLFW_EXPOSE_NATIVE_GLX
+#include <GL/glfw3native.h>
+#include <X11/XKBlib.h>
+#include <X11/keysym.h>
+#include <poll.h>
+#include <errno.h>
+#include <pthread.h>
+#include <atomic>
+#endif
+
+SpscQueue<InputThread::Event, 1024> InputThread::events;
+bool InputThread::running = false;
+
+#ifdef __linux__
+
+static Display * display = NULL;
+static pthread_t thread;
+static int wakePipe[2] = { -1, -1 };
+static bool keyIsDown[KEY_COUNT];
+static std::atomic<unsigned int> lostCount(0);
+static XErrorHandler prevErrorHandler = NULL;
+static bool selectInputFailed = false;
+static Key keyCodeTable[256];
+
+// XKB names of the physical keys on the US layout, the table GLFW maps keys with,
+// so bindings do not depend on NO_INPUT_THREAD with any layout
+static const struct
+{
+  Key key;
+  const char * name;
+} keyNames[] =
+{
+  { KB_GRAVE_ACCENT, "TLDE" }, { KB_1, "AE01" }, { KB_2, "AE02" }, { KB_3, "AE03" },
+  { KB_4, "AE04" }, { KB_5, "AE05" }, { KB_6, "AE06" }, { KB_7, "AE07" }, { KB_8, "AE08" },
+  { KB_9, "AE09" }, { KB_0, "AE10" }, { KB_MINUS, "AE11" }, { KB_EQUAL, "AE12" },
+  { KB_Q, "AD01" }, { KB_W, "AD02" }, { KB_E, "AD03" }, { KB_R, "AD04" }, { KB_T, "AD05" },
+  { KB_Y, "AD06" }, { KB_U, "AD07" }, { KB_I, "AD08" }, { KB_O, "AD09" }, { KB_P, "AD10" },
+  { KB_LEFT_BRACKET, "AD11" }, { KB_RIGHT_BRACKET, "AD12" },
+  { KB_A, "AC01" }, { KB_S, "AC02" }, { KB_D, "AC03" }, { KB_F, "AC04" }, { KB_G, "AC05" },
+  { KB_H, "AC06" }, { KB_J, "AC07" }, { KB_K, "AC08" }, { KB_L, "AC09" }, { KB_SEMICOLON, "AC10" },
+  { KB_APOSTROPHE, "AC11" },
+  { KB_Z, "AB01" }, { KB_X, "AB02" }, { KB_C, "AB03" }, { KB_V, "AB04" }, { KB_B, "AB05" },
+  { KB_N, "AB06" }, { KB_M, "AB07" }, { KB_COMMA, "AB08" }, { KB_PERIOD, "AB09" }, { KB_SLASH, "AB10" },
+  { KB_BACKSLASH, "BKSL" }, { KB_WORLD_1, "LSGT" }, { KB_SPACE, "SPCE" }, { KB_ESCAPE, "ESC" },
+  { KB_ENTER, "RTRN" }, { KB_TAB, "TAB" }, { KB_BACKSPACE, "BKSP" }, { KB_INSERT, "INS" },
+  { KB_DELETE, "DELE" }, { KB_RIGHT, "RGHT" }, { KB_LEFT, "LEFT" }, { KB_DOWN, "DOWN" }, { KB_UP, "UP" },
+  { KB_PAGE_UP, "PGUP" }, { KB_PAGE_DOWN, "PGDN" }, { KB_HOME, "HOME" }, { KB_END, "END" },
+  { KB_CAPS_LOCK, "CAPS" }, { KB_SCROLL_LOCK, "SCLK" }, { KB_NUM_LOCK, "NMLK" },
+  { KB_PRINT_SCREEN, "PRSC" }, { KB_PAUSE, "PAUS" },
+  { KB_F1, "FK01" }, { KB_F2, "FK02" }, { KB_F3, "FK03" }, { KB_F4, "FK04" }, { KB_F5, "FK05" },
+  { KB_F6, "FK06" }, { KB_F7, "FK07" }, { KB_F8, "FK08" }, { KB_F9, "FK09" }, { KB_F10, "FK10" },
+  { KB_F11, "FK11" }, { KB_F12, "FK12" }, { KB_F13, "FK13" }, { KB_F14, "FK14" }, { KB_F15, "FK15" },
+  { KB_F16, "FK16" }, { KB_F17, "FK17" }, { KB_F18, "FK18" }, { KB_F19, "FK19" }, { KB_F20, "FK20" },
+  { KB_F21, "FK21" }, { KB_F22, "FK22" }, { KB_F23, "FK23" }, { KB_F24, "FK24" }, { KB_F25, "FK25" },
+  { KB_KP_DIVIDE, "KPDV" }, { KB_KP_MULTIPLY, "KPMU" }, { KB_KP_SUBTRACT, "KPSU" }, { KB_KP_ADD, "KPAD" },
+  { KB_KP_0, "KP0" }, { KB_KP_1, "KP1" }, { KB_KP_2, "KP2" }, { KB_KP_3, "KP3" }, { KB_KP_4, "KP4" },
+  { KB_KP_5, "KP5" }, { KB_KP_6, "KP6" }, { KB_KP_7, "KP7" }, { KB_KP_8, "KP8" }, { KB_KP_9, "KP9" },
+  { KB_KP_DECIMAL, "KPDL" }, { KB_KP_EQUAL, "KPEQ" }, { KB_KP_ENTER, "KPEN" },
+  { KB_LEFT_SHIFT, "LFSH" }, { KB_LEFT_CONTROL, "LCTL" }, { KB_LEFT_ALT, "LALT" }, { KB_LEFT_SUPER, "LWIN" },
+  { KB_RIGHT_SHIFT, "RTSH" }, { KB_RIGHT_CONTROL, "RCTL" }, { KB_RIGHT_ALT, "RALT" },
+  { KB_RIGHT_ALT, "LVL3" }, { KB_RIGHT_ALT, "MDSW" }, { KB_RIGHT_SUPER, "RWIN" }, { KB_MENU, "MENU" },
+};
+
+
+static Key translateKeySym(KeySym keySym)
+{
+  if (keySym >= XK_a && keySym <= XK_z)
+    return Key(KB_A + (keySym - XK_a));
+
+  if (keySym >= XK_0 && keySym <= XK_9)
+    return Key(KB_0 + (keySym - XK_0));
+
+  if (keySym >= XK_F1 && keySym <= XK_F25)
+    return Key(KB_F1 + (keySym - XK_F1));
+
+  if (keySym >= XK_KP_0 && keySym <= XK_KP_9)
+    return Key(KB_KP_0 + (keySym - XK_KP_0));
+
+  switch (keySym)
+  {
+    case XK_space: return KB_SPACE;
+    case XK_apostrophe: return KB_APOSTROPHE;
+    case XK_comma: return KB_COMMA;
+    case XK_minus: return KB_MINUS;
+    case XK_period: return KB_PERIOD;
+    case XK_slash: return KB_SLASH;
+    case XK_semicolon: return KB_SEMICOLON;
+    case XK_equal: return KB_EQUAL;
+    case XK_bracketleft: return KB_LEFT_BRACKET;
+    case XK_backslash: return KB_BACKSLASH;
+    case XK_bracketright: return KB_RIGHT_BRACKET;
+    case XK_grave: return KB_GRAVE_ACCENT;
+    case XK_less: return KB_WORLD_1;
+    case XK_Escape: return KB_ESCAPE;
+    case XK_Return: return KB_ENTER;
+    case XK_Tab: return KB_TAB;
+    case XK_BackSpace: return KB_BACKSPACE;
+    case XK_Insert: return KB_INSERT;
+    case XK_Delete: return KB_DELETE;
+    case XK_Right: return KB_RIGHT;
+    case XK_Left: return KB_LEFT;
+    case XK_Down: return KB_DOWN;
+    case XK_Up: return KB_UP;
+    case XK_Page_Up: return KB_PAGE_UP;
+    case XK_Page_Down: return KB_PAGE_DOWN;
+    case XK_Home: return KB_HOME;
+    case XK_End: return KB_END;
+    case XK_Caps_Lock: return KB_CAPS_LOCK;
+    case XK_Scroll_Lock: return KB_SCROLL_LOCK;
+    case XK_Num_Lock: return KB_NUM_LOCK;
+    case XK_Print: return KB_PRINT_SCREEN;
+    case XK_Pause: return KB_PAUSE;
+    case XK_KP_Decimal: return KB_KP_DECIMAL;
+    case XK_KP_Divide: return KB_KP_DIVIDE;
+    case XK_KP_Multiply: return KB_KP_MULTIPLY;
+    case XK_KP_Subtract: return KB_KP_SUBTRACT;
+    case XK_KP_Add: return KB_KP_ADD;
+    case XK_KP_Enter: return KB_KP_ENTER;
+    case XK_KP_Equal: return KB_KP_EQUAL;
+    case XK_Shift_L: return KB_LEFT_SHIFT;
+    case XK_Control_L: return KB_LEFT_CONTROL;
+    case XK_Alt_L: return KB_LEFT_ALT;
+    case XK_Super_L: return KB_LEFT_SUPER;
+    case XK_Shift_R: return KB_RIGHT_SHIFT;
+    case XK_Control_R: return KB_RIGHT_CONTROL;
+    case XK_Alt_R: return KB_RIGHT_ALT;
+    case XK_ISO_Level3_Shift: return KB_RIGHT_ALT;
+    case XK_Super_R: return KB_RIGHT_SUPER;
+    case XK_Menu: return KB_MENU;
+    default: return KB_NONE;
+  }
+}
+
+
+// keypad keys are taken from the second level like GLFW does, so they do not depend on num lock
+static Key translateKeyCodeSym(KeyCode keyCode)
+{
+  KeySym keySym = XkbKeycodeToKeysym(display, keyCode, 0, 1);
+
+  if ((keySym >= XK_KP_0 && keySym <= XK_KP_9) || keySym == XK_KP_Decimal || keySym == XK_KP_Equal)
+    return translateKeySym(keySym);
+
+  return translateKeySym(XkbKeycodeToKeysym(display, keyCode, 0, 0));
+}
+
+
+static Key findKeyName(const char * name)
+{
+  for (size_t i = 0; i < sizeof(keyNames) / sizeof(keyNames[0]); i++)
+    if (!strncmp(name, keyNames[i].name, XkbKeyNameLength))
+      return keyNames[i].key;
+
+  return KB_NONE;
+}
+
+
+// by the XKB key name first, then by an alias of it, then by the keysym for keys without a known name
+static void buildKeyCodeTable()
+{
+  for (int i = 0; i < 256; i++)
+    keyCodeTable[i] = KB_NONE;
+
+  XkbDescPtr desc = XkbGetMap(display, 0, XkbUseCoreKbd);
+
+  if (desc && XkbGetNames(display, XkbKeyNamesMask | XkbKeyAliasesMask, desc) == Success)
+  {
+    for (int keyCode = desc->min_key_code; keyCode <= desc->max_key_code; keyCode++)
+    {
+      const char * name = desc->names->keys[keyCode].name;
+      Key key = findKeyName(name);
+
+      for (int i = 0; key == KB_NONE && i < desc->names->num_key_aliases; i++)
+        if (!strncmp(desc->names->key_aliases[i].real, name, XkbKeyNameLength))
+          key = findKeyName(desc->names->key_aliases[i].alias);
+
+      keyCodeTable[keyCode] = key;
+    }
+
+    XkbFreeNames(desc, XkbKeyNamesMask | XkbKeyAliasesMask, True);
+  }
+
+  if (desc)
+    XkbFreeKeyboard(desc, 0, True);
+
+  for (int keyCode = 0; keyCode < 256; keyCode++)
+    if (keyCodeTable[keyCode] == KB_NONE)
+      keyCodeTable[keyCode] = translateKeyCodeSym(KeyCode(keyCode));
+}
+
+
+static Key translateKey(XKeyEvent & event)
+{
+  return event.keycode < 256 ? keyCodeTable[event.keycode] : KB_NONE;
+}
+
+
+// errors of other connections go to the handler that was set before
+static int onSelectInputError(Display * errorDisplay, XErrorEvent * errorEvent)
+{
+  if (errorDisplay != display)
+    return prevErrorHandler ? prevErrorHandler(errorDisplay, errorEvent) : 0;
+
+  selectInputFailed = true;
+  return 0;
+}
+
+
+void * InputThread::run(void *)
+{
+  pollfd fds[2];
+  fds[0].fd = ConnectionNumber(display);
+  fds[0].events = POLLIN;
+  fds[1].fd = wakePipe[0];
+  fds[1].events = POLLIN;
+
+  for (;;)
+  {
+    bool pushed = false;
+
+    // XPending also reads what has arrived on the socket
+    while (XPending(display))
+    {
+      XEvent event;
+      XNextEvent(display, &event);
+      const uint64_t counter = Crosy::getPerformanceCounter();
+
+      // releases go to another window after focus loss, so release everything now like GLFW does
+      if (event.type == FocusOut && event.xfocus.mode != NotifyGrab && event.xfocus.mode != NotifyUngrab)
+      {
+        for (Key key = FIRST_KEY; key < KEY_COUNT; key++)
+          if (keyIsDown[key])
+          {
+            keyIsDown[key] = false;
+            Event inputEvent = { key, false, counter };
+
+            if (events.push(inputEvent))
+              pushed = true;
+            else
+              lostCount.fetch_add(1, std::memory_order_relaxed);
+          }
+
+        continue;
+      }
+
+      if (event.type != KeyPress && event.type != KeyRelease)
+        continue;
+
+      const Key key = translateKey(event.xkey);
+      const bool isDown = (event.type == KeyPress);
+
+      // with detectable autorepeat a held key sends more presses only, Control makes own repeats
+      if (key == KB_NONE || keyIsDown[key] == isDown)
+        continue;
+
+      keyIsDown[key] = isDown;
+      Event inputEvent = { key, isDown, counter };
+
+      if (events.push(inputEvent))
+        pushed = true;
+      else
+        lostCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (pushed)
+      glfwPostEmptyEvent();
+
+    fds[0].revents = 0;
+    fds[1].revents = 0;
+
+    if (poll(fds, 2, -1) < 0 && errno != EINTR)
+      break;
+
+    if (fds[1].revents || (fds[0].revents & (POLLERR | POLLHUP)))
+      break;
+  }
+
+  return NULL;
+}
+
+
+bool InputThread::start(GLFWwindow * window)
+{
+  assert(!running);
+
+  if (running || getenv("NO_INPUT_THREAD"))
+    return false;
+
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 4)
+  if (glfwGetPlatform() != GLFW_PLATFORM_X11)
+  {
+    std::cout << "Input thread: not an X11 window, using GLFW key events\n";
+    return false;
+  }
+#endif
+
+  // a Wayland window of GLFW 3.4 has no X11 window
+  const Window x11Window = glfwGetX11Window(window);
+
+  if (x11Window == None)
+  {
+    std::cout << "Input thread: not an X11 window, using GLFW key events\n";
+    return false;
+  }
+
+  display = XOpenDisplay(NULL);
+
+  if (!display)
+  {
+    std::cout << "Input thread: cannot open X display, using GLFW key events\n";
+    return false;
+  }
+
+  Bool detectableAutoRepeat = False;
+  XkbSetDetectableAutoRepeat(display, True, &detectableAutoRepeat);
+
+  // without it repeats come as release/press pairs and cannot be told from real presses
+  if (!detectableAutoRepeat)
+  {
+    std::cout << "Input thread: no detectable autorepeat, using GLFW key events\n";
+    XCloseDisplay(display);
+    display = NULL;
+    return false;
+  }
+
+  // the default error handler would exit the game on the input thread's next XPending,
+  // so the request is synced and its error caught here
+  selectInputFailed = false;
+  prevErrorHandler = XSetErrorHandler(onSelectInputError);
+  XSelectInput(display, x11Window, KeyPressMask | KeyReleaseMask | FocusChangeMask);
+  XSync(display, False);
+  XSetErrorHandler(prevErrorHandler);
+  prevErrorHandler = NULL;
+
+  if (selectInputFailed)
+  {
+    std::cout << "Input thread: cannot select key events on the window, using GLFW key events\n";
+    XCloseDisplay(display);
+    display = NULL;
+    return false;
+  }
+
+  if (pipe(wakePipe) != 0)
+  {
+    std::cout << "Input thread: cannot create pipe, using GLFW key events\n";
+    XCloseDisplay(display);
+    display = NULL;
+    return false;
+  }
+
+  memset(keyIsDown, 0, sizeof(keyIsDown));
+  buildKeyCodeTable();
+
+  if (pthread_create(&thread, NULL, run, NULL) != 0)
+  {
+    std::cout << "Input thread: pthread_create failed, using GLFW key events\n";
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+    XCloseDisplay(display);
+    display = NULL;
+    return false;
+  }
+
+  running = true;
+
+  return true;
+}
+
+
+void InputThread::stop()
+{
+  if (!running)
+    return;
+
+  const char wake = 0;
+
+  while (write(wakePipe[1], &wake, 1) < 0 && errno == EINTR)
+    ;
+
+  pthread_join(thread, NULL);
+  close(wakePipe[0]);
+  close(wakePipe[1]);
+  XCloseDisplay(display);
+  display = NULL;
+  running = false;
+}
+
+
+unsigned int InputThread::getLostCount()
+{
+  return lostCount.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool InputThread::start(GLFWwindow *)
+{
+  return false;
+}
+
+
+void InputThread::stop()
+{
+}
+
+
+unsigned int InputThread::getLostCount()
+{
+  return 0;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Keys.h"
+#include <mm_core/spsc_queue.h>
+
+// Keyboard reader running on own thread (Linux/X11). It opens a second X connection,
+// selects key events on the game window and sleeps in poll() on the connection socket,
+// so every key is stamped with the performance counter right when the server sends it
+// instead of when the next frame polls GLFW. The main thread takes the events with pop(),
+// an empty GLFW event is posted to wake it when it waits for events. Keys are mapped by their
+// XKB names, the physical position, the same way GLFW maps them.
+// Not available on other platforms or when NO_INPUT_THREAD environment variable is set,
+// GLFW key callbacks are used then.
+class InputThread
+{
+public:
+  struct Event
+  {
+    Key key;
+    bool isDown;
+    uint64_t counter;
+  };
+
+  static bool start(GLFWwindow * window);
+  static void stop();
+  static bool isRunning() { return running; }
+  static bool pop(Event & event) { return events.pop(event); }
+  static bool hasEvents() { return !events.empty(); }
+  static unsigned int getLostCount();
+
+private:
+  static SpscQueue<Event, 1024> events;
+  static bool running;
+
+  static void * run(void *);
+
+  InputThread();
+  ~InputThread();
+};
@@ -294,3 +294,25 @@ void InterfaceLogic::exitToMainMenu()
   state = stMainMenu;
   result = resStopGame;
 }
+
+
+// true while a menu, settings or leaderboard window is showing or hiding
+bool InterfaceLogic::isAnimating()
+{
+  const MenuLogic * const menus[] = 
+  { 
+    &mainMenu, 
+    &inGameMenu, 
+    &quitConfirmationMenu, 
+    &restartConfirmationMenu, 
+    &exitToMainConfirmationMenu, 
+    &settingsLogic.saveConfirmationMenu 
+  };
+
+  for (const MenuLogic * menu : menus)
+    if (menu->state == MenuLogic::stShowing || menu->state == MenuLogic::stHiding)
+      return true;
+
+  return settingsLogic.state == SettingsLogic::stShowing || settingsLogic.state == SettingsLogic::stHiding ||
+         leaderboardLogic.state == LeaderboardLogic::stShowing || leaderboardLogic.state == LeaderboardLogic::stHiding;
+}
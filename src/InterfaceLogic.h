@@ -42,6 +42,7 @@ public:
   static void showMainMenu();
   static void showInGameMenu();
   static void showLeaderboard();
+  static bool isAnimating();
 
 private:
   InterfaceLogic();
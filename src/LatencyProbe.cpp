@@ -0,0 +1,169 @@
+#include "static_headers.h"
+
+#include "LatencyProbe.h"
+#include "Binding.h"
+#include "Crosy.h"
+#include "GameEvents.h"
+#include "GameLogic.h"
+#include "Globals.h"
+#include <stdlib.h>
+
+const char * const LatencyProbe::stageNames[STAGE_COUNT] =
+{
+  "logic",
+  "submitted",
+  "swapped",
+  "cleared",
+};
+
+LatencyProbe::LatencyProbe() :
+  freq(0),
+  nextProbeCounter(0),
+  pressCounter(0),
+  lastStage(-1),
+  waitFrames(0),
+  inFlight(false),
+  moveRight(false),
+  missedCount(0),
+  enabled(false)
+{
+}
+
+
+LatencyProbe::~LatencyProbe()
+{
+}
+
+
+void LatencyProbe::init()
+{
+  enabled = (getenv("LATENCY_PROBE") != NULL);
+  freq = Crosy::getPerformanceFrequency();
+  nextProbeCounter = Crosy::getPerformanceCounter() + freq;
+
+  for (int i = 0; i < STAGE_COUNT; i++)
+    samples[i].reserve(maxSamples);
+}
+
+
+void LatencyProbe::inject(Control & control)
+{
+  if (!enabled || inFlight || samples[stCleared].size() >= maxSamples)
+    return;
+
+  if (GameLogic::state != GameLogic::stPlaying || GameLogic::haveFallingRows)
+    return;
+
+  const uint64_t counter = Crosy::getPerformanceCounter();
+
+  if (counter < nextProbeCounter)
+    return;
+
+  const Key key = Binding::getActionKey(moveRight ? Binding::moveRight : Binding::moveLeft);
+
+  if (key == KB_NONE)
+    return;
+
+  control.keyEvent(key, true, counter);
+  control.keyEvent(key, false, counter);
+  pressCounter = counter;
+  lastStage = -1;
+  waitFrames = 0;
+  inFlight = true;
+}
+
+
+void LatencyProbe::logicDone()
+{
+  if (!inFlight)
+    return;
+
+  const GameEvents::Type shiftEvent = moveRight ? GameEvents::evShiftRight : GameEvents::evShiftLeft;
+
+  for (int i = 0, cnt = GameEvents::getCount(); i < cnt; i++)
+    if (GameEvents::get(i).type == shiftEvent)
+    {
+      markStage(stLogic);
+      return;
+    }
+
+  // the figure is at the wall or the game has stopped: try the other direction later
+  if (++waitFrames > maxWaitFrames)
+  {
+    missedCount++;
+    finishProbe();
+  }
+}
+
+
+void LatencyProbe::frameSubmitted()
+{
+  markStage(stSubmitted);
+}
+
+
+void LatencyProbe::frameSwapped()
+{
+  markStage(stSwapped);
+}
+
+
+void LatencyProbe::frameCleared()
+{
+  markStage(stCleared);
+
+  if (inFlight && lastStage == stCleared)
+  {
+    for (int i = 0; i < STAGE_COUNT; i++)
+      samples[i].push_back(float(double(stageCounters[i] - pressCounter) * 1000.0 / freq));
+
+    finishProbe();
+  }
+}
+
+
+// stages after logic are only stamped once the frame carrying the change has reached them
+void LatencyProbe::markStage(Stage stage)
+{
+  if (inFlight && lastStage == int(stage) - 1)
+  {
+    stageCounters[stage] = Crosy::getPerformanceCounter();
+    lastStage = stage;
+  }
+}
+
+
+void LatencyProbe::finishProbe()
+{
+  inFlight = false;
+  moveRight = !moveRight;
+  // random phase, so probes do not lock to the vSync period
+  const double interval = 0.25 + 0.25 * double(fastrand()) / FAST_RAND_MAX;
+  nextProbeCounter = Crosy::getPerformanceCounter() + uint64_t(interval * freq);
+}
+
+
+float LatencyProbe::getPercentile(std::vector<float> & values, float fraction)
+{
+  if (values.empty())
+    return 0.0f;
+
+  const size_t index = glm::min(size_t(fraction * values.size()), values.size() - 1);
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+
+  return values[index];
+}
+
+
+void LatencyProbe::print()
+{
+  if (!enabled)
+    return;
+
+  printf("Input latency, %d probes, %d missed (ms from key press):\n", (int)samples[stCleared].size(), missedCount);
+
+  for (int i = 0; i < STAGE_COUNT; i++)
+    printf("  %-10s p50 %6.2f  p90 %6.2f  p99 %6.2f  max %6.2f\n", stageNames[i],
+           getPercentile(samples[i], 0.5f), getPercentile(samples[i], 0.9f), getPercentile(samples[i], 0.99f),
+           getPercentile(samples[i], 1.0f));
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Control.h"
+
+// Input-to-screen latency measurement, enabled by LATENCY_PROBE environment variable.
+// While the game is played it injects a press and release of the move left/right key every
+// 0.25..0.5 sec (alternating, so the figure stays in place), waits for the shift to show up
+// in the game events and stamps each following stage of that frame. Percentiles of the
+// time from the injected press to every stage are printed on exit.
+class LatencyProbe
+{
+private:
+  enum Stage
+  {
+    stLogic,      // Control and Logic applied the key
+    stSubmitted,  // render.update returned, the frame is issued to GL
+    stSwapped,    // glfwSwapBuffers returned
+    stCleared,    // the GL command after the swap returned, vSync wait is over
+    STAGE_COUNT
+  };
+
+  enum { maxSamples = 4096 };
+  enum { maxWaitFrames = 10 };
+
+  static const char * const stageNames[STAGE_COUNT];
+
+  uint64_t freq;
+  uint64_t nextProbeCounter;
+  uint64_t pressCounter;
+  uint64_t stageCounters[STAGE_COUNT];
+  int lastStage;
+  int waitFrames;
+  bool inFlight;
+  bool moveRight;
+  int missedCount;
+  std::vector<float> samples[STAGE_COUNT];
+
+  void markStage(Stage stage);
+  void finishProbe();
+  static float getPercentile(std::vector<float> & values, float fraction);
+
+public:
+  bool enabled;
+
+  LatencyProbe();
+  ~LatencyProbe();
+
+  void init();
+  // main loop stages, called in this order every frame
+  void inject(Control & control);
+  void logicDone();
+  void frameSubmitted();
+  void frameSwapped();
+  void frameCleared();
+  void print();
+};
@@ -3,7 +3,7 @@
 #include "Layout.h"
 #include "InterfaceLogic.h"
 #include "Binding.h"
-#include "Crosy.h"
+#include "AssetPack.h"
 
 const float Layout::screenLeft = 0.0f;
 const float Layout::screenTop = 0.0f;
@@ -133,18 +133,19 @@ float Layout::leaderboardPanelScoreRightIndent = 0.01f;
 float Layout::leaderboardPanelLastRowBottomGap = 0.01f;
 
 LayoutObject Layout::screen(loScreen, NULL, screenLeft, screenTop, screenWidth, screenHeight);
+LayoutObject * Layout::objects[LAYOUT_OBJECT_COUNT];
+float Layout::hitGridLeft = 0.0f;
+float Layout::hitGridTop = 0.0f;
+float Layout::hitGridCellWidth = 1.0f;
+float Layout::hitGridCellHeight = 1.0f;
+std::vector<LayoutObject *> Layout::hitGridCells[hitGridSize * hitGridSize];
 
 void Layout::load(const char * name)
 {
   rapidjson::Document doc;
-  std::string fileName = Crosy::getExePath() + "/layouts/" + name + ".json";
-  FILE * file = fopen(fileName.c_str(), "rb");
-  assert(file);
-  const int bufSize = 16384;
-  char buf[bufSize];
-  rapidjson::FileReadStream frstream(file, buf, bufSize);
-  doc.ParseStream<rapidjson::FileReadStream>(frstream);
-  fclose(file);
+  std::string fileName = std::string("layouts/") + name + ".json";
+  bool loaded = AssetPack::loadJson(fileName.c_str(), doc);
+  assert(loaded);
 
   loadValue(doc, "BackgroundWidth", &backgroundWidth);
   loadValue(doc, "BackgroundHeight", &backgroundHeight);
@@ -512,6 +513,80 @@ void Layout::load(const char * name)
 
   for (int i = 0; i < 3; i++)
     leaderboardBackButtonLayout->addColumn(i ? leaderboardBackButtonColumnShift : 0.0f, leaderboardBackShevronSize);
+
+  memset(objects, 0, sizeof(objects));
+  int hitRank = 0;
+  screen.buildIndex(objects, &hitRank);
+  buildHitGrid();
+}
+
+
+void Layout::buildHitGrid()
+{
+  float left = screen.getGlobalLeft();
+  float top = screen.getGlobalTop();
+  float right = left + screen.width;
+  float bottom = top + screen.height;
+  std::vector<LayoutObject *> hitOrder;
+
+  for (int id = loNone + 1; id < LAYOUT_OBJECT_COUNT; id++)
+    if (LayoutObject * object = objects[id])
+    {
+      left = glm::min(left, object->getGlobalLeft());
+      top = glm::min(top, object->getGlobalTop());
+      right = glm::max(right, object->getGlobalLeft() + object->width);
+      bottom = glm::max(bottom, object->getGlobalTop() + object->height);
+      hitOrder.push_back(object);
+    }
+
+  std::sort(hitOrder.begin(), hitOrder.end(),
+            [](const LayoutObject * a, const LayoutObject * b) { return a->isHitBefore(*b); });
+
+  hitGridLeft = left;
+  hitGridTop = top;
+  hitGridCellWidth = glm::max(right - left, VERY_SMALL_NUMBER) / hitGridSize;
+  hitGridCellHeight = glm::max(bottom - top, VERY_SMALL_NUMBER) / hitGridSize;
+
+  for (int i = 0; i < hitGridSize * hitGridSize; i++)
+    hitGridCells[i].clear();
+
+  for (LayoutObject * object : hitOrder)
+  {
+    const int firstColumn = getHitGridCell(object->getGlobalLeft(), hitGridLeft, hitGridCellWidth);
+    const int lastColumn = getHitGridCell(object->getGlobalLeft() + object->width, hitGridLeft, hitGridCellWidth);
+    const int firstRow = getHitGridCell(object->getGlobalTop(), hitGridTop, hitGridCellHeight);
+    const int lastRow = getHitGridCell(object->getGlobalTop() + object->height, hitGridTop, hitGridCellHeight);
+
+    for (int row = firstRow; row <= lastRow; row++)
+      for (int column = firstColumn; column <= lastColumn; column++)
+        hitGridCells[row * hitGridSize + column].push_back(object);
+  }
+}
+
+
+int Layout::getHitGridCell(float value, float start, float cellSize)
+{
+  const int cell = int(floorf((value - start) / cellSize));
+  return glm::clamp(cell, 0, hitGridSize - 1);
+}
+
+
+LayoutObject * Layout::getObjectFromPoint(LayoutObjectId root, float x, float y)
+{
+  const LayoutObject * rootObject = getObject(root);
+
+  if (!rootObject)
+    return NULL;
+
+  const int column = getHitGridCell(x, hitGridLeft, hitGridCellWidth);
+  const int row = getHitGridCell(y, hitGridTop, hitGridCellHeight);
+  const std::vector<LayoutObject *> & cell = hitGridCells[row * hitGridSize + column];
+
+  for (LayoutObject * object : cell)
+    if (object->isInSubtreeOf(*rootObject) && object->containsPoint(x, y))
+      return object;
+
+  return NULL;
 }
 
 
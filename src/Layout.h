@@ -5,7 +5,19 @@
 class Layout
 {
 private:
+  static LayoutObject * objects[LAYOUT_OBJECT_COUNT];
+
+  // uniform grid over the screen, each cell lists the objects overlapping it in hit test order
+  static const int hitGridSize = 16;
+  static float hitGridLeft;
+  static float hitGridTop;
+  static float hitGridCellWidth;
+  static float hitGridCellHeight;
+  static std::vector<LayoutObject *> hitGridCells[hitGridSize * hitGridSize];
+
   static void loadValue(rapidjson::Value & source, const char * name, float * result);
+  static void buildHitGrid();
+  static int getHitGridCell(float value, float start, float cellSize);
 
   Layout();
   ~Layout();
@@ -143,4 +155,17 @@ public:
   static LayoutObject screen;
 
   static void load(const char * name);
+
+  // O(1), the index is rebuilt by load()
+  static LayoutObject * getObject(LayoutObjectId id)
+  {
+    assert(id > loNone && id < LAYOUT_OBJECT_COUNT);
+    assert(objects[id]);
+
+    return (id > loNone && id < LAYOUT_OBJECT_COUNT) ? objects[id] : NULL;
+  }
+
+  // deepest object of the 'root' subtree containing the point, NULL if none; does not
+  // depend on the number of objects in the layout
+  static LayoutObject * getObjectFromPoint(LayoutObjectId root, float x, float y);
 };
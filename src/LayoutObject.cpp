@@ -4,8 +4,12 @@
 
 LayoutObject::LayoutObject(LayoutObjectId id, LayoutObject * parent, 
                            float left, float top, float width, float height) :
-  id(id),
   parent(parent),
+  globalLeft(parent ? parent->globalLeft + left : left),
+  globalTop(parent ? parent->globalTop + top : top),
+  hitRank(0),
+  firstHitRank(0),
+  id(id),
   left(left),
   top(top),
   width(width),
@@ -35,30 +39,17 @@ LayoutObject * LayoutObject::addChild(LayoutObjectId id, float left, float top,
 }
 
 
-LayoutObject * LayoutObject::getChild(LayoutObjectId id)
+// stores this object and all its descendants by id and assigns hit test ranks
+void LayoutObject::buildIndex(LayoutObject * index[LAYOUT_OBJECT_COUNT], int * nextHitRank)
 {
-  ChildIterator childIt = childList.find(id);
-  assert(childIt != childList.end());
-
-  if (childIt == childList.end())
-    return NULL;
-  
-  return &childIt->second;
-}
-
+  assert(id > loNone && id < LAYOUT_OBJECT_COUNT);
+  index[id] = this;
+  firstHitRank = *nextHitRank;
 
-LayoutObject * LayoutObject::getChildRecursive(LayoutObjectId id)
-{
   for (ChildIterator childIt = childList.begin(); childIt != childList.end(); ++childIt)
-  {
-    if (childIt->first == id)
-      return &childIt->second;
+    childIt->second.buildIndex(index, nextHitRank);
 
-    if (LayoutObject * obj = childIt->second.getChildRecursive(id))
-      return obj;
-  }
-
-  return NULL;
+  hitRank = (*nextHitRank)++;
 }
 
 
@@ -80,66 +71,63 @@ void LayoutObject::addColumn(float leftGap, float width)
 }
 
 
-LayoutObject * LayoutObject::getObjectFromPoint(float x, float y)
+bool LayoutObject::containsPoint(float x, float y) const
 {
-  for (ChildIterator childIt = childList.begin(); childIt != childList.end(); ++childIt)
-  {
-    LayoutObject * object = childIt->second.getObjectFromPoint(x, y);
-
-    if (object)
-      return object;
-  }
-
-  const float left = getGlobalLeft();
-  const float top = getGlobalTop();
-  const float right = left + width;
-  const float bottom = top + height;
+  return x >= globalLeft && x <= globalLeft + width && y >= globalTop && y <= globalTop + height;
+}
 
-  if (x >= left && x <= right && y >= top && y <= bottom)
-    return this;
 
-  return NULL;
+bool LayoutObject::isInSubtreeOf(const LayoutObject & object) const
+{
+  return hitRank >= object.firstHitRank && hitRank <= object.hitRank;
 }
 
 
-bool LayoutObject::getCellFromPoint(float x, float y, int * cellRow, int * cellColumn) const
+// Rows and columns are added one after another, so their begins are sorted: binary search
+// for the last one beginning before the value, then step back over overlapping ones to
+// return the first interval containing the value. -1 if none.
+template <typename Interval>
+int LayoutObject::findInterval(const std::vector<Interval> & intervals, float Interval::*begin, float Interval::*size,
+                               float value)
 {
-  const float clientX = x - getGlobalLeft();
-  const float clientY = y - getGlobalTop();
+  int low = 0;
+  int high = (int)intervals.size();
 
-  if (clientX < 0 || clientX > width || clientY < 0 || clientY > height)
-    return false;
+  while (low < high)
+  {
+    int middle = (low + high) / 2;
 
-  int row = 0;
-  int rowCount = (int)rows.size();
+    if (intervals[middle].*begin <= value)
+      low = middle + 1;
+    else
+      high = middle;
+  }
 
-  while(row < rowCount)
-  {
-    const RowData & rowData = rows[row];
+  int index = low - 1;
 
-    if (clientY >= rowData.top && clientY <= rowData.top + rowData.height)
-      break;
+  while (index > 0 && value <= intervals[index - 1].*begin + intervals[index - 1].*size)
+    --index;
 
-    ++row;
-  }
+  if (index < 0 || value > intervals[index].*begin + intervals[index].*size)
+    return -1;
 
-  if (row == rowCount)
-    return false;
+  return index;
+}
 
-  int column = 0;
-  int columnCount = (int)columns.size();
 
-  while (column < columnCount)
-  {
-    const ColumnData & columnData = columns[column];
+bool LayoutObject::getCellFromPoint(float x, float y, int * cellRow, int * cellColumn) const
+{
+  if (!containsPoint(x, y))
+    return false;
 
-    if (clientX >= columnData.left && clientX <= columnData.left + columnData.width)
-      break;
+  int row = findInterval(rows, &RowData::top, &RowData::height, y - globalTop);
 
-    ++column;
-  }
+  if (row < 0)
+    return false;
+
+  int column = findInterval(columns, &ColumnData::left, &ColumnData::width, x - globalLeft);
 
-  if (column == columnCount)
+  if (column < 0)
     return false;
 
   if (cellRow)
@@ -154,13 +142,13 @@ bool LayoutObject::getCellFromPoint(float x, float y, int * cellRow, int * cellC
 
 float LayoutObject::getGlobalLeft() const
 {
-  return parent ? parent->getGlobalLeft() + left : left;
+  return globalLeft;
 }
 
 
 float LayoutObject::getGlobalTop() const
 {
-  return parent ? parent->getGlobalTop() + top : top;
+  return globalTop;
 }
 
 
@@ -43,6 +43,7 @@ enum LayoutObjectId
   loLeaderboardTitleShadow,
   loLeaderboardPanel,
   loLeaderboardBackButton,
+  LAYOUT_OBJECT_COUNT
 };
 
 class LayoutObject
@@ -67,6 +68,16 @@ private:
 
   std::vector<RowData> rows;
   std::vector<ColumnData> columns;
+  float globalLeft; // objects do not move after creation, so the parent chain is summed once
+  float globalTop;
+  // hit test order: descendants before the object itself, children in id order;
+  // the subtree of an object takes ranks [firstHitRank, hitRank]
+  int hitRank;
+  int firstHitRank;
+
+  template <typename Interval>
+  static int findInterval(const std::vector<Interval> & intervals, float Interval::*begin, float Interval::*size,
+                          float value);
 
 public:
   struct Rect
@@ -89,12 +100,13 @@ public:
 
   void clear();
   LayoutObject * addChild(LayoutObjectId id, float left, float top, float width, float height);
-  LayoutObject * getChild(LayoutObjectId id);
-  LayoutObject * getChildRecursive(LayoutObjectId id);
+  void buildIndex(LayoutObject * index[LAYOUT_OBJECT_COUNT], int * nextHitRank);
   void addRow(float topGap, float height);
   void addColumn(float leftGap, float width);
 
-  LayoutObject * getObjectFromPoint(float x, float y);
+  bool containsPoint(float x, float y) const;
+  bool isHitBefore(const LayoutObject & object) const { return hitRank < object.hitRank; }
+  bool isInSubtreeOf(const LayoutObject & object) const;
   bool getCellFromPoint(float x, float y, int * cellRow, int * cellColumn) const;
 
   float getGlobalLeft() const;
@@ -2,6 +2,7 @@
 
 #include "LeaderboardLogic.h"
 #include "Globals.h"
+#include "GameEvents.h"
 #include "Time.h"
 #include "Crosy.h"
 
@@ -48,6 +49,7 @@ LeaderboardLogic::Result LeaderboardLogic::update()
   {
   case stHidden:
     state = stShowing;
+    GameEvents::push(GameEvents::evMenuShowing);
     break;
   case stVisible:
     break;
@@ -87,6 +89,7 @@ void LeaderboardLogic::escape()
   assert(state == stVisible);
 
   state = stHiding;
+  GameEvents::push(GameEvents::evMenuHiding);
 }
 
 
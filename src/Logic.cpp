@@ -1,6 +1,7 @@
 #include "static_headers.h"
 
 #include "Logic.h"
+#include "Profiler.h"
 
 Logic::Result Logic::result = resNone;
 
@@ -13,6 +14,7 @@ void Logic::init()
 
 void Logic::update()
 {
+  PROFILE_SCOPE("Logic::update");
   switch (GameLogic::update())
   {
     case GameLogic::resGameOver:
@@ -2,6 +2,7 @@
 
 #include "MenuLogic.h"
 #include "Globals.h"
+#include "GameEvents.h"
 #include "Time.h"
 
 MenuLogic::MenuLogic(Result escapeResult) :
@@ -34,6 +35,7 @@ MenuLogic::Result MenuLogic::update()
       result = resNone;
       state = stShowing;
       selectedRow = defaultRow;
+      GameEvents::push(GameEvents::evMenuShowing);
       break;
 
     case stShowing:
@@ -126,6 +128,7 @@ void MenuLogic::enter()
 
   result = itemList[selectedRow].result;
   state = stHiding;
+  GameEvents::push(GameEvents::evMenuHiding);
 }
 
 
@@ -147,6 +150,9 @@ void MenuLogic::escape()
   result = escapeResult;
 
   if (escapeResult != resNone)
+  {
     state = stHiding;
+    GameEvents::push(GameEvents::evMenuHiding);
+  }
 }
 
@@ -4,11 +4,24 @@
 #include "Logic.h"
 #include "Crosy.h"
 #include "Time.h"
+#include "GameEvents.h"
 #include "Layout.h"
 #include "Palette.h"
 #include "Sound.h"
-
-OpenGLApplication::OpenGLApplication()
+#include "AssetPack.h"
+#include "InputThread.h"
+#include "Profiler.h"
+
+#define GLFW_HAS_WAIT_EVENTS_TIMEOUT (GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 2))
+
+OpenGLApplication::OpenGLApplication() :
+  refreshPeriod(0.0),
+  lastSwapTime(0.0),
+  swapInterval(0.0),
+  idleWaitEnabled(false),
+  eventsReceived(false),
+  idleWakeArmed(false),
+  idleWakerExiting(false)
 {
   initGlfwKeyMap();
 }
@@ -65,6 +78,7 @@ bool OpenGLApplication::init()
   glfwSetMouseButtonCallback(wnd, OnMouseClick);
   glfwSetCursorPosCallback(wnd, OnMouseMove);
   glfwSetScrollCallback(wnd, OnMouseScroll);
+  glfwSetWindowRefreshCallback(wnd, OnWindowRefresh);
   glewExperimental = GL_FALSE;
   GLenum glewInitResult = glewInit();
   assert(glewInitResult == GLEW_OK);
@@ -78,12 +92,27 @@ bool OpenGLApplication::init()
 
   glfwSetWindowTitle(wnd, "TetrisGL");
 
+  Profiler::init();
+  AssetPack::open((Crosy::getExePath() + "assets.pak").c_str());
   Layout::load("default");
   Palette::load("default");
   Sound::init();
   control.init();
+  InputThread::start(wnd);
   render.init(wndWidth, wndHeight);
   fps.init();
+  framePacer.init();
+  refreshPeriod = vidMode->refreshRate > 0 ? 1.0 / vidMode->refreshRate : 0.0;
+  updateFramePeriod();
+  fps.setBudget(framePacer.targetFps > 0.0f ? 1.0f / framePacer.targetFps : 1.0f / 60.0f);
+  render.fpsCounter = fps.graphEnabled ? &fps : NULL;
+  idleWaitEnabled = (getenv("NO_IDLE_WAIT") == NULL);
+
+#if !GLFW_HAS_WAIT_EVENTS_TIMEOUT
+  if (idleWaitEnabled)
+    idleWaker = std::thread(&OpenGLApplication::runIdleWaker, this);
+#endif
+  latencyProbe.init();
 
   return true;
 }
@@ -91,20 +120,42 @@ bool OpenGLApplication::init()
 
 void OpenGLApplication::run()
 {
+  // longest idle wait, Sound::update still runs this often
+  const double maxIdleWait = 0.25;
   bool exitFlag = false;
+  bool redraw = true;
 
   while (!exitFlag)
   {
+    PROFILE_SCOPE("frame");
     PerfTime::update();
+    GameEvents::beginFrame();
     glfwPollEvents();
 
+    InputThread::Event inputEvent;
+
+    while (InputThread::pop(inputEvent))
+      control.keyEvent(inputEvent.key, inputEvent.isDown, inputEvent.counter);
+
+    latencyProbe.inject(control);
     control.update();
     Logic::update();
+    latencyProbe.logicDone();
     Sound::update();
-    render.update();
+
+    if (redraw)
+    {
+      render.update();
+      latencyProbe.frameSubmitted();
+    }
 
     if (fps.enabled)
-      glfwSetWindowTitle(wnd, fps.count(0.5f));
+    {
+      char * fpsText = fps.count(0.5f);
+
+      if (fps.titleEnabled)
+        glfwSetWindowTitle(wnd, fpsText);
+    }
 
     glfwSwapInterval((int)vSync);
 
@@ -117,33 +168,149 @@ void OpenGLApplication::run()
     if (glfwWindowShouldClose(wnd) || Logic::result == Logic::resExitApp)
       exitFlag = true;
 
-    if (vSync)
+    if (redraw)
     {
-      float maxSleepTime = 0.001f;
-      const float targetFps = 100.0f;
-      float currentTimerDelta = PerfTime::getCurrentTimerDelta();
+      if (vSync)
+        framePacer.wait();
 
-      while (currentTimerDelta + maxSleepTime < 1.0f / targetFps)
       {
-        float prevDelta = currentTimerDelta;
-        Crosy::sleep(1);
-        currentTimerDelta = PerfTime::getCurrentTimerDelta();
-        maxSleepTime = glm::max(currentTimerDelta - prevDelta, maxSleepTime);
-      } 
+        PROFILE_SCOPE("swap");
+        glfwSwapBuffers(wnd);
+        latencyProbe.frameSwapped();
+        // opengl may delay vSync waiting until next gl command
+        // so call glClear to ensue that vSync waiting will be performed before PerfTime::update
+        glClear(GL_COLOR_BUFFER_BIT);
+        latencyProbe.frameCleared();
+      }
+
+      // a hitch must not make every later sound late, so long intervals count as 0.1 s
+      const double swapTime = PerfTime::getCurrentTimer();
+      const double interval = glm::min(swapTime - lastSwapTime, 0.1);
+
+      if (lastSwapTime > 0.0)
+        swapInterval = swapInterval > 0.0 ? swapInterval + (interval - swapInterval) / 16.0 : interval;
+
+      lastSwapTime = swapTime;
+      updateFramePeriod();
+
+      assert(!checkGlErrors());
+    }
+
+    redraw = true;
+
+    if (!exitFlag && idleWaitEnabled && isIdle())
+    {
+      const double redrawDelay = getNextRedrawDelay();
+      const bool redrawScheduled = (redrawDelay >= 0.0 && redrawDelay <= maxIdleWait);
+      PROFILE_SCOPE("idle wait");
+      eventsReceived = false;
+      waitEvents(redrawScheduled ? redrawDelay : maxIdleWait);
+      eventsReceived = eventsReceived || InputThread::hasEvents();
+      // waiting time is not animation time for whatever the event starts
+      PerfTime::update();
+      framePacer.restart();
+      fps.restart();
+      lastSwapTime = 0.0;
+      redraw = eventsReceived || redrawScheduled;
     }
+  }
+}
+
+
+// Sound lets events get one frame old before they start late. With vSync frames come no faster
+// than the monitor refresh and the pacer may hold them longer; without vSync the pacer does
+// not run and only the measured swap interval tells the frame time
+void OpenGLApplication::updateFramePeriod()
+{
+  Sound::setFramePeriod(vSync ? glm::max(framePacer.getPeriod(), refreshPeriod) : swapInterval);
+}
+
+
+// nothing on the screen changes until some input comes
+bool OpenGLApplication::isIdle() const
+{
+  if (GameLogic::state != GameLogic::stPaused && GameLogic::state != GameLogic::stStopped)
+    return false;
+
+  return !InterfaceLogic::isAnimating() && !render.isAnimating();
+}
+
+
+// seconds until an idle screen has to be redrawn, negative if never
+double OpenGLApplication::getNextRedrawDelay() const
+{
+  // blinking cursor of the leaderboard name editor
+  if (InterfaceLogic::state == InterfaceLogic::stLeaderboard && InterfaceLogic::leaderboardLogic.editRow >= 0)
+  {
+    const uint64_t halfPeriod = PerfTime::freq / 2;
+    return double(halfPeriod - Crosy::getPerformanceCounter() % halfPeriod) / PerfTime::freq;
+  }
+
+  return -1.0;
+}
+
+
+void OpenGLApplication::waitEvents(double timeout)
+{
+#if GLFW_HAS_WAIT_EVENTS_TIMEOUT
+  glfwWaitEventsTimeout(timeout);
+#else
+  {
+    std::lock_guard<std::mutex> lock(idleWakerMutex);
+    idleWakeTime = std::chrono::steady_clock::now() + std::chrono::microseconds(int64_t(timeout * 1000000.0));
+    idleWakeArmed = true;
+  }
+
+  idleWakerCondition.notify_one();
+  glfwWaitEvents();
+
+  std::lock_guard<std::mutex> lock(idleWakerMutex);
+  idleWakeArmed = false;
+#endif
+}
+
+
+void OpenGLApplication::runIdleWaker()
+{
+  std::unique_lock<std::mutex> lock(idleWakerMutex);
 
-    glfwSwapBuffers(wnd);
-    // opengl may delay vSync waiting until next gl command
-    // so call glClear to ensue that vSync waiting will be performed before PerfTime::update
-    glClear(GL_COLOR_BUFFER_BIT);
-    assert(!checkGlErrors());
+  while (!idleWakerExiting)
+  {
+    if (!idleWakeArmed)
+      idleWakerCondition.wait(lock);
+    else if (idleWakerCondition.wait_until(lock, idleWakeTime) == std::cv_status::timeout && idleWakeArmed)
+    {
+      idleWakeArmed = false;
+      glfwPostEmptyEvent();
+    }
   }
 }
 
 
 void OpenGLApplication::quit()
 {
+  InputThread::stop();
+
+  if (idleWaker.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> lock(idleWakerMutex);
+      idleWakerExiting = true;
+    }
+
+    idleWakerCondition.notify_one();
+    idleWaker.join();
+  }
+
+  latencyProbe.print();
+  framePacer.print();
+  fps.quit();
+  render.printStats();
+  Profiler::quit();
   render.quit();
+  // samples may point into the asset pack mapping
+  Sound::quit();
+  AssetPack::close();
   glfwTerminate();
 }
 
@@ -152,6 +319,7 @@ void OpenGLApplication::OnFramebufferSize(GLFWwindow * wnd, int width, int heigh
 {
   OpenGLApplication & app = *reinterpret_cast<OpenGLApplication *>(glfwGetWindowUserPointer(wnd));
 
+  app.eventsReceived = true;
   app.wndWidth = width;
   app.wndHeight = height;
 
@@ -164,9 +332,16 @@ void OpenGLApplication::OnKeyClick(GLFWwindow * wnd, int key, int scancode, int
   if (key >= 0 && key <= GLFW_KEY_LAST && key != GLFW_KEY_UNKNOWN)
   {
     OpenGLApplication & app = *reinterpret_cast<OpenGLApplication *>(glfwGetWindowUserPointer(wnd));
+    app.eventsReceived = true;
 
     if (action == GLFW_PRESS && key == GLFW_KEY_F11)
+    {
       app.vSync = !app.vSync;
+      app.updateFramePeriod();
+    }
+
+    if (action == GLFW_PRESS && key == GLFW_KEY_F12)
+      Profiler::dump();
 
 #ifdef _DEBUG
     if (action == GLFW_PRESS && key == GLFW_KEY_RIGHT_ALT)
@@ -177,11 +352,17 @@ void OpenGLApplication::OnKeyClick(GLFWwindow * wnd, int key, int scancode, int
 
     if (action == GLFW_PRESS && key == GLFW_KEY_F5)
     {
+      // the asset pack stays mapped, sound samples may point into it; edited loose files win over it
+      AssetPack::preferFiles = true;
       Layout::load("default");
       Palette::load("default");
     }
 #endif
 
+    // keys come from the input thread when it runs
+    if (InputThread::isRunning())
+      return;
+
     switch (action)
     {
       case GLFW_PRESS:
@@ -200,6 +381,7 @@ void OpenGLApplication::OnKeyClick(GLFWwindow * wnd, int key, int scancode, int
 void OpenGLApplication::OnMouseClick(GLFWwindow * wnd, int button, int action, int mods)
 {
   OpenGLApplication & app = *reinterpret_cast<OpenGLApplication *>(glfwGetWindowUserPointer(wnd));
+  app.eventsReceived = true;
 
   switch (button)
   {
@@ -222,6 +404,7 @@ void OpenGLApplication::OnMouseClick(GLFWwindow * wnd, int button, int action, i
 void OpenGLApplication::OnMouseMove(GLFWwindow* wnd, double xpos, double ypos)
 {
   OpenGLApplication & app = *reinterpret_cast<OpenGLApplication *>(glfwGetWindowUserPointer(wnd));
+  app.eventsReceived = true;
 
   if (app.wndWidth && app.wndHeight)
   {
@@ -249,11 +432,20 @@ void OpenGLApplication::OnMouseMove(GLFWwindow* wnd, double xpos, double ypos)
 void OpenGLApplication::OnMouseScroll(GLFWwindow* wnd, double dx, double dy)
 {
   OpenGLApplication & app = *reinterpret_cast<OpenGLApplication *>(glfwGetWindowUserPointer(wnd));
+  app.eventsReceived = true;
 
   app.control.mouseScroll((float)dx, (float)dy);
 }
 
 
+// the window system lost the window contents, e.g. while it was covered
+void OpenGLApplication::OnWindowRefresh(GLFWwindow * wnd)
+{
+  OpenGLApplication & app = *reinterpret_cast<OpenGLApplication *>(glfwGetWindowUserPointer(wnd));
+  app.eventsReceived = true;
+}
+
+
 void OpenGLApplication::initGlfwKeyMap()
 {
   memset(glfwKeyMap, 0, sizeof(glfwKeyMap));
@@ -1,6 +1,8 @@
 #pragma once
 #include "Application.h"
 #include "FpsCounter.h"
+#include "FramePacer.h"
+#include "LatencyProbe.h"
 #include "OpenGLRender.h"
 #include "Control.h"
 
@@ -8,15 +10,37 @@ class OpenGLApplication : public Application
 {
 private:
   FpsCounter fps;
+  FramePacer framePacer;
+  LatencyProbe latencyProbe;
   OpenGLRender render;
   Control control;
   GLFWwindow * wnd;
   bool vSync;
+  // frame intervals for the event age Sound allows for: the monitor refresh and the measured swaps
+  double refreshPeriod;
+  double lastSwapTime;
+  double swapInterval;
   int wndWidth;
   int wndHeight;
   Key glfwKeyMap[GLFW_KEY_LAST + 1];
+  // idle mode: when nothing animates the loop waits for events instead of redrawing
+  bool idleWaitEnabled;
+  bool eventsReceived;
+  // GLFW 3.1 has no glfwWaitEventsTimeout, this thread posts an empty event when a wait times out
+  std::thread idleWaker;
+  std::mutex idleWakerMutex;
+  std::condition_variable idleWakerCondition;
+  std::chrono::steady_clock::time_point idleWakeTime;
+  bool idleWakeArmed;
+  bool idleWakerExiting;
 
   void initGlfwKeyMap();
+  void updateFramePeriod();
+  bool isIdle() const;
+  double getNextRedrawDelay() const;
+  void waitEvents(double timeout);
+  void runIdleWaker();
+  static void OnWindowRefresh(GLFWwindow * wnd);
   static void OnFramebufferSize(GLFWwindow * wnd, int width, int height);
   static void OnKeyClick(GLFWwindow * wnd, int key, int scancode, int action, int mods);
   static void OnMouseClick(GLFWwindow * wnd, int button, int action, int mods);
@@ -8,6 +8,8 @@
 #include "Time.h"
 #include "Layout.h"
 #include "Palette.h"
+#include "Profiler.h"
+#include "AssetPack.h"
 #include <stdlib.h>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -21,14 +23,72 @@ static const char * my_itoa(int i, char * buf, int base)
 }
 
 
+const char * const OpenGLRender::statsLayerNames[STATS_LAYER_COUNT] =
+{
+  "game",
+  "settings",
+  "leaderboard",
+  "menu",
+  "overlay",
+};
+
+const char * const OpenGLRender::gpuTrackNames[STATS_LAYER_COUNT] =
+{
+  "gpu game layer",
+  "gpu settings layer",
+  "gpu leaderboard layer",
+  "gpu menu layer",
+  "gpu overlay layer",
+};
+
+const char * const OpenGLRender::statsBuilderNames[STATS_BUILDER_COUNT] =
+{
+  "background",
+  "field",
+  "hold figure",
+  "next figures",
+  "drop trails",
+  "row flashes",
+  "drop predictor",
+  "countdown",
+  "level up",
+  "menu",
+  "settings window",
+  "leaderboard window",
+};
+
+
 OpenGLRender::OpenGLRender() :
+  showWireframe(false),
+  fpsCounter(NULL),
+  statsEnabled(false),
+  gpuTimersEnabled(false),
+  edgeBlurWidth(0.005f),
+  keyBindBkShade(0.0f),
   commonVert(GL_VERTEX_SHADER),
   commonFrag(GL_FRAGMENT_SHADER),
   fontVert(GL_VERTEX_SHADER),
   fontFrag(GL_FRAGMENT_SHADER),
-  edgeBlurWidth(0.005f),
-  showWireframe(false)
+  statsLayer(slGame),
+  statsFrameCount(0),
+  gpuQueryFrame(0),
+  activeGpuQuery(-1),
+  gpuFrameCount(0),
+  gpuMissedCount(0),
+  gpuTrackEnd(0)
 {
+  frameStats.clear();
+  lastFrameStats.clear();
+  sumStats.clear();
+  peakStats.clear();
+  heaviestFrameStats.clear();
+  memset(gpuQueryIds, 0, sizeof(gpuQueryIds));
+  memset(gpuQueryIssued, 0, sizeof(gpuQueryIssued));
+  memset(gpuQueryCounters, 0, sizeof(gpuQueryCounters));
+  memset(lastGpuTimes, 0, sizeof(lastGpuTimes));
+  memset(sumGpuTimes, 0, sizeof(sumGpuTimes));
+  memset(peakGpuTimes, 0, sizeof(peakGpuTimes));
+
   for (int ind = (int)FIRST_TEX_INDEX; ind < TEX_INDEX_COUNT; ind++)
   {
     texPos[ind].x = 0.0625f + 0.25f * (ind % 4);
@@ -43,6 +103,8 @@ OpenGLRender::OpenGLRender() :
 
 void OpenGLRender::init(int width, int height)
 {
+  statsEnabled = (getenv("RENDER_STATS") != NULL);
+  initGpuTimers();
   glGenVertexArrays(1, &vaoId);
   assert(!checkGlErrors());
   glBindVertexArray(vaoId);
@@ -146,11 +208,10 @@ void OpenGLRender::init(int width, int height)
   fontProg.use();
   fontProg.setUniform("tex", 0);
 
-  int imageWidth, imageHeight, channels;
-  std::string bkTextureFileName = Crosy::getExePath() + "/textures/BackgroundTile.png";
+  int imageWidth, imageHeight;
 
-  if (unsigned char * bkTextureImage = stbi_load(bkTextureFileName.c_str(),
-      &imageWidth, &imageHeight, &channels, 4))
+  if (const unsigned char * bkTextureImage = AssetPack::loadImage("textures/BackgroundTile.png", 4,
+      &imageWidth, &imageHeight))
   {
     glGenTextures(1, &bkTextureId);
     assert(!checkGlErrors());
@@ -159,7 +220,7 @@ void OpenGLRender::init(int width, int height)
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, imageWidth, imageHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE,
                  bkTextureImage);
     assert(!checkGlErrors());
-    free(bkTextureImage);
+    AssetPack::freeImage(bkTextureImage);
     glGenerateMipmap(GL_TEXTURE_2D);
     assert(!checkGlErrors());
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -172,10 +233,8 @@ void OpenGLRender::init(int width, int height)
   else
     assert(0);
 
-  std::string mainAtlasFileName = Crosy::getExePath() + "/textures/MainAtlas.png";
-
-  if (unsigned char * mainAtlasImage = stbi_load(mainAtlasFileName.c_str(),
-      &imageWidth, &imageHeight, &channels, 4))
+  if (const unsigned char * mainAtlasImage = AssetPack::loadImage("textures/MainAtlas.png", 4,
+      &imageWidth, &imageHeight))
   {
     glGenTextures(1, &atlasTextureId);
     assert(!checkGlErrors());
@@ -184,7 +243,7 @@ void OpenGLRender::init(int width, int height)
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, imageWidth, imageHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE,
                  mainAtlasImage);
     assert(!checkGlErrors());
-    free(mainAtlasImage);
+    AssetPack::freeImage(mainAtlasImage);
     glGenerateMipmap(GL_TEXTURE_2D);
     assert(!checkGlErrors());
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -197,12 +256,13 @@ void OpenGLRender::init(int width, int height)
   else
     assert(0);
 
-  std::string fontTextureFileName = Crosy::getExePath() + "/fonts/MontserratTexture.png";
-  std::string fontMetricsFileName = Crosy::getExePath() + "/fonts/MontserratMetrics.json";
-  font.load(fontMetricsFileName.c_str());
+  rapidjson::Document fontMetrics;
+  bool fontMetricsLoaded = AssetPack::loadJson("fonts/MontserratMetrics.json", fontMetrics);
+  assert(fontMetricsLoaded);
+  font.load(fontMetrics);
 
-  if (unsigned char * fontTextureImage = stbi_load(fontTextureFileName.c_str(),
-      &imageWidth, &imageHeight, &channels, 1))
+  if (const unsigned char * fontTextureImage = AssetPack::loadImage("fonts/MontserratTexture.png", 1,
+      &imageWidth, &imageHeight))
   {
     glGenTextures(1, &fontTextureId);
     assert(!checkGlErrors());
@@ -211,7 +271,7 @@ void OpenGLRender::init(int width, int height)
     glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, imageWidth, imageHeight, 0, GL_ALPHA, GL_UNSIGNED_BYTE,
                  fontTextureImage);
     assert(!checkGlErrors());
-    free(fontTextureImage);
+    AssetPack::freeImage(fontTextureImage);
     glGenerateMipmap(GL_TEXTURE_2D);
     assert(!checkGlErrors());
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -239,6 +299,7 @@ void OpenGLRender::init(int width, int height)
 
 void OpenGLRender::quit()
 {
+  quitGpuTimers();
   commonProg.quit();
   commonVert.quit();
   commonFrag.quit();
@@ -297,6 +358,7 @@ void OpenGLRender::resize(int width, int height)
 
 void OpenGLRender::update()
 {
+  PROFILE_SCOPE("OpenGLRender::update");
 #ifdef _DEBUG
   if (showWireframe)
   {
@@ -323,15 +385,38 @@ void OpenGLRender::update()
   glClear(GL_COLOR_BUFFER_BIT);
   assert(!checkGlErrors());
 
+  readGpuTimers();
+  beginGpuTimer(slGame);
   updateGameLayer();
+  beginGpuTimer(slSettings);
   updateSettingsLayer();
+  beginGpuTimer(slLeaderboard);
   updateLeaderboardLayer();
+  beginGpuTimer(slMenu);
   updateMenuLayer();
+  beginGpuTimer(slOverlay);
+  updateOverlayLayer();
+  endGpuTimer();
+  gpuQueryFrame = (gpuQueryFrame + 1) % gpuTimerLatency;
+  finishFrameStats();
+}
+
+
+// effects that change without input while the game is not running
+bool OpenGLRender::isAnimating() const
+{
+  if (InterfaceLogic::state != InterfaceLogic::stSettings)
+    return false;
+
+  const float keyBindBkShadeTarget = (InterfaceLogic::settingsLogic.state == SettingsLogic::stKeyWaiting) ? 1.0f : 0.0f;
+
+  return keyBindBkShade != keyBindBkShadeTarget;
 }
 
 
 void OpenGLRender::drawMesh()
 {
+  PROFILE_SCOPE("OpenGLRender::drawMesh");
   if (!bkVertexBuffer.empty())
   {
     glEnableVertexAttribArray(0);
@@ -359,6 +444,11 @@ void OpenGLRender::drawMesh()
     glDrawArrays(GL_TRIANGLES, 0, (int)bkVertexBuffer.size());
     assert(!checkGlErrors());
 
+    LayerStats & layerStats = frameStats.layers[statsLayer];
+    layerStats.drawCalls++;
+    layerStats.vertices[vbBk] += bkVertexBuffer.size();
+    layerStats.uploadBytes += bkVertexBuffer.size() * sizeof(Vertex);
+
     glDisableVertexAttribArray(0);
     assert(!checkGlErrors());
     glDisableVertexAttribArray(1);
@@ -394,6 +484,11 @@ void OpenGLRender::drawMesh()
     glDrawArrays(GL_TRIANGLES, 0, (int)atlasVertexBuffer.size());
     assert(!checkGlErrors());
 
+    LayerStats & layerStats = frameStats.layers[statsLayer];
+    layerStats.drawCalls++;
+    layerStats.vertices[vbAtlas] += atlasVertexBuffer.size();
+    layerStats.uploadBytes += atlasVertexBuffer.size() * sizeof(Vertex);
+
     glDisableVertexAttribArray(0);
     assert(!checkGlErrors());
     glDisableVertexAttribArray(1);
@@ -433,6 +528,11 @@ void OpenGLRender::drawMesh()
     glDrawArrays(GL_TRIANGLES, 0, (int)textVertexBuffer.size());
     assert(!checkGlErrors());
 
+    LayerStats & layerStats = frameStats.layers[statsLayer];
+    layerStats.drawCalls++;
+    layerStats.vertices[vbText] += textVertexBuffer.size();
+    layerStats.uploadBytes += textVertexBuffer.size() * sizeof(TextVertex);
+
     glDisableVertexAttribArray(0);
     assert(!checkGlErrors());
     glDisableVertexAttribArray(1);
@@ -666,6 +766,8 @@ void OpenGLRender::buildProgressBar(float left, float top, float width, float he
 
 void OpenGLRender::buildBackground()
 {
+  PROFILE_SCOPE("OpenGLRender::buildBackground");
+  BuilderStatsScope builderStats(*this, sbBackground);
   // base game background
   glm::vec2 origin(Layout::backgroundLeft, Layout::backgroundTop);
 
@@ -727,7 +829,7 @@ void OpenGLRender::buildBackground()
   }
 
   // field background
-  if (LayoutObject * fieldLayout = Layout::screen.getChildRecursive(loField))
+  if (LayoutObject * fieldLayout = Layout::getObject(loField))
   {
     origin.x = fieldLayout->getGlobalLeft();
     origin.y = fieldLayout->getGlobalTop();
@@ -803,7 +905,7 @@ void OpenGLRender::buildBackground()
   }
 
   // score caption
-  if (LayoutObject * scoreBarCaptionLayout = Layout::screen.getChildRecursive(loScoreBarCaption))
+  if (LayoutObject * scoreBarCaptionLayout = Layout::getObject(loScoreBarCaption))
   {
     const float left = scoreBarCaptionLayout->getGlobalLeft();
     const float top = scoreBarCaptionLayout->getGlobalTop();
@@ -815,7 +917,7 @@ void OpenGLRender::buildBackground()
   }
 
   // score value
-  if (LayoutObject * scoreBarValueLayout = Layout::screen.getChildRecursive(loScoreBarValue))
+  if (LayoutObject * scoreBarValueLayout = Layout::getObject(loScoreBarValue))
   {
     const float left = scoreBarValueLayout->getGlobalLeft();
     const float top = scoreBarValueLayout->getGlobalTop();
@@ -829,7 +931,7 @@ void OpenGLRender::buildBackground()
   }
 
   // 'menu' button
-  if (LayoutObject * scoreBarMenuButtonLayout = Layout::screen.getChildRecursive(loScoreBarMenuButton))
+  if (LayoutObject * scoreBarMenuButtonLayout = Layout::getObject(loScoreBarMenuButton))
   {
     const float left = scoreBarMenuButtonLayout->getGlobalLeft();
     const float top = scoreBarMenuButtonLayout->getGlobalTop();
@@ -849,7 +951,7 @@ void OpenGLRender::buildBackground()
   }
 
   // hold figure panel
-  if (LayoutObject * holdPanelCaptionLayout = Layout::screen.getChildRecursive(loHoldPanelCaption))
+  if (LayoutObject * holdPanelCaptionLayout = Layout::getObject(loHoldPanelCaption))
   {
     const float left = holdPanelCaptionLayout->getGlobalLeft();
     const float top = holdPanelCaptionLayout->getGlobalTop();
@@ -859,7 +961,7 @@ void OpenGLRender::buildBackground()
                   Palette::holdCaptionText, 1.0f, 0.0f, haCenter, vaCenter);
   }
 
-  if (LayoutObject * holdPanelLayout = Layout::screen.getChildRecursive(loHoldPanel))
+  if (LayoutObject * holdPanelLayout = Layout::getObject(loHoldPanel))
   {
     const float left = holdPanelLayout->getGlobalLeft();
     const float top = holdPanelLayout->getGlobalTop();
@@ -873,7 +975,7 @@ void OpenGLRender::buildBackground()
   }
 
   // next figure
-  if (LayoutObject * nextPanelCaptionLayout = Layout::screen.getChildRecursive(loNextPanelCaption))
+  if (LayoutObject * nextPanelCaptionLayout = Layout::getObject(loNextPanelCaption))
   {
     const float left = nextPanelCaptionLayout->getGlobalLeft();
     const float top = nextPanelCaptionLayout->getGlobalTop();
@@ -883,7 +985,7 @@ void OpenGLRender::buildBackground()
                   Palette::nextCaptionText, 1.0f, 0.0f, haCenter, vaCenter);
   }
 
-  if (LayoutObject * nextPanelLayout = Layout::screen.getChildRecursive(loNextPanel))
+  if (LayoutObject * nextPanelLayout = Layout::getObject(loNextPanel))
   {
     const float left = nextPanelLayout->getGlobalLeft();
     const float top = nextPanelLayout->getGlobalTop();
@@ -897,7 +999,7 @@ void OpenGLRender::buildBackground()
   }
 
   // level panel
-  if (LayoutObject * levelPanelCaptionLayout = Layout::screen.getChildRecursive(loLevelPanelCaption))
+  if (LayoutObject * levelPanelCaptionLayout = Layout::getObject(loLevelPanelCaption))
   {
     const float left = levelPanelCaptionLayout->getGlobalLeft();
     const float top = levelPanelCaptionLayout->getGlobalTop();
@@ -907,7 +1009,7 @@ void OpenGLRender::buildBackground()
                   Palette::levelCaptionText, 1.0f, 0.0f, haCenter, vaCenter);
   }
 
-  if (LayoutObject * levelPanelLayout = Layout::screen.getChildRecursive(loLevelPanel))
+  if (LayoutObject * levelPanelLayout = Layout::getObject(loLevelPanel))
   {
     const float left = levelPanelLayout->getGlobalLeft();
     const float top = levelPanelLayout->getGlobalTop();
@@ -922,7 +1024,7 @@ void OpenGLRender::buildBackground()
   }
 
   // goal panel
-  if (LayoutObject * goalPanelCaptionLayout = Layout::screen.getChildRecursive(loGoalPanelCaption))
+  if (LayoutObject * goalPanelCaptionLayout = Layout::getObject(loGoalPanelCaption))
   {
     const float left = goalPanelCaptionLayout->getGlobalLeft();
     const float top = goalPanelCaptionLayout->getGlobalTop();
@@ -932,7 +1034,7 @@ void OpenGLRender::buildBackground()
                   Palette::goalCaptionText, 1.0f, 0.0f, haCenter, vaCenter);
   }
 
-  if (LayoutObject * goalPanelLayout = Layout::screen.getChildRecursive(loGoalPanel))
+  if (LayoutObject * goalPanelLayout = Layout::getObject(loGoalPanel))
   {
     const float left = goalPanelLayout->getGlobalLeft();
     const float top = goalPanelLayout->getGlobalTop();
@@ -950,7 +1052,9 @@ void OpenGLRender::buildBackground()
 
 void OpenGLRender::buidField()
 {
-  if (LayoutObject * fieldLayout = Layout::screen.getChildRecursive(loField))
+  PROFILE_SCOPE("OpenGLRender::buidField");
+  BuilderStatsScope builderStats(*this, sbField);
+  if (LayoutObject * fieldLayout = Layout::getObject(loField))
   {
     const float scale = fieldLayout->width / Field::width;
     const glm::vec2 fieldPos(fieldLayout->getGlobalLeft(), fieldLayout->getGlobalTop());
@@ -1000,9 +1104,11 @@ void OpenGLRender::buidField()
 
 void OpenGLRender::buildHoldFigure()
 {
+  PROFILE_SCOPE("OpenGLRender::buildHoldFigure");
+  BuilderStatsScope builderStats(*this, sbHoldFigure);
   if (GameLogic::haveHold)
   {
-    if (LayoutObject * holdPanelLayout = Layout::screen.getChildRecursive(loHoldPanel))
+    if (LayoutObject * holdPanelLayout = Layout::getObject(loHoldPanel))
     {
       const float scale = Layout::holdNextFigureScale;
       const float holdPanelLeft = holdPanelLayout->getGlobalLeft();
@@ -1028,7 +1134,9 @@ void OpenGLRender::buildHoldFigure()
 
 void OpenGLRender::buildNextFigures()
 {
-  if (LayoutObject * nextPanelLayout = Layout::screen.getChildRecursive(loNextPanel))
+  PROFILE_SCOPE("OpenGLRender::buildNextFigures");
+  BuilderStatsScope builderStats(*this, sbNextFigures);
+  if (LayoutObject * nextPanelLayout = Layout::getObject(loNextPanel))
   {
     const float scale = Layout::holdNextFigureScale;
     const float nextPanelLeft = nextPanelLayout->getGlobalLeft();
@@ -1443,7 +1551,9 @@ void OpenGLRender::buildCellGlow(const glm::vec2 & origin, float scale, const Ce
 
 void OpenGLRender::buildDropTrails()
 {
-  if (LayoutObject * fieldLayout = Layout::screen.getChildRecursive(loField))
+  PROFILE_SCOPE("OpenGLRender::buildDropTrails");
+  BuilderStatsScope builderStats(*this, sbDropTrails);
+  if (LayoutObject * fieldLayout = Layout::getObject(loField))
   {
     const float left = fieldLayout->getGlobalLeft();
     const float top = fieldLayout->getGlobalTop();
@@ -1489,7 +1599,9 @@ void OpenGLRender::buildDropTrails()
 
 void OpenGLRender::buildRowFlashes()
 {
-  if (LayoutObject * fieldLayout = Layout::screen.getChildRecursive(loField))
+  PROFILE_SCOPE("OpenGLRender::buildRowFlashes");
+  BuilderStatsScope builderStats(*this, sbRowFlashes);
+  if (LayoutObject * fieldLayout = Layout::getObject(loField))
   {
     const float fieldLeft = fieldLayout->getGlobalLeft();
     const float fieldTop = fieldLayout->getGlobalTop();
@@ -1891,6 +2003,8 @@ void OpenGLRender::buildWindow(float left, float top, float width, float height,
 
 void OpenGLRender::buildMenu(MenuLogic * menuLogic, LayoutObject * menuLayout)
 {
+  PROFILE_SCOPE("OpenGLRender::buildMenu");
+  BuilderStatsScope builderStats(*this, sbMenu);
   assert(menuLogic);
   assert(menuLayout);
 
@@ -2030,9 +2144,11 @@ float OpenGLRender::buildTextMesh(float left, float top, float width, float heig
 
 void OpenGLRender::buildSettingsWindow()
 {
-  if (LayoutObject * settingsLayout = Layout::screen.getChild(loSettings))
+  PROFILE_SCOPE("OpenGLRender::buildSettingsWindow");
+  BuilderStatsScope builderStats(*this, sbSettingsWindow);
+  if (Layout::getObject(loSettings))
   {
-    if (LayoutObject * settingsWindowLayout = settingsLayout->getChild(loSettingsWindow))
+    if (LayoutObject * settingsWindowLayout = Layout::getObject(loSettingsWindow))
     {
       const float opProgress = 1.0f - InterfaceLogic::settingsLogic.transitionProgress;
       const float sqOpProgress = opProgress * opProgress;
@@ -2046,7 +2162,7 @@ void OpenGLRender::buildSettingsWindow()
       buildWindow(left, top, width, height, Layout::settingsCornerSize, Layout::settingsGlowWidth, 
                   Palette::settingsBackgroundTop, Palette::settingsBackgroundBottom, Palette::settingsGlow);
 
-      if (LayoutObject * settingTitleShadowLayout = settingsWindowLayout->getChild(loSettingsTitleShadow))
+      if (LayoutObject * settingTitleShadowLayout = Layout::getObject(loSettingsTitleShadow))
       {
         const float left = settingTitleShadowLayout->getGlobalLeft();
         const float top = settingTitleShadowLayout->getGlobalTop() + shift;
@@ -2056,7 +2172,7 @@ void OpenGLRender::buildSettingsWindow()
                       Palette::settingsTitleShadowAlpha, Palette::settingsTitleShadowBlur, haLeft, vaTop);
       }
 
-      if (LayoutObject * settingTitleLayout = settingsWindowLayout->getChild(loSettingsTitle))
+      if (LayoutObject * settingTitleLayout = Layout::getObject(loSettingsTitle))
       {
         const float left = settingTitleLayout->getGlobalLeft();
         const float top = settingTitleLayout->getGlobalTop() + shift;
@@ -2066,7 +2182,7 @@ void OpenGLRender::buildSettingsWindow()
                       Palette::settingsTitleText, 1.0f, 0.0f, haLeft, vaTop);
       }
 
-      if (LayoutObject * settingPanelLayout = settingsWindowLayout->getChild(loSettingsPanel))
+      if (LayoutObject * settingPanelLayout = Layout::getObject(loSettingsPanel))
       {
         const float left = settingPanelLayout->getGlobalLeft();
         const float top = settingPanelLayout->getGlobalTop() + shift;
@@ -2077,7 +2193,7 @@ void OpenGLRender::buildSettingsWindow()
         buildFrameRect(left, top, width, height, Layout::settingsPanelBorderWidth, 
                        Palette::settingsPanelBorder, 1.0f);
 
-        if (LayoutObject * volumeTitleLayout = settingPanelLayout->getChild(loVolumeTitle))
+        if (LayoutObject * volumeTitleLayout = Layout::getObject(loVolumeTitle))
         {
           const float left = volumeTitleLayout->getGlobalLeft();
           const float top = volumeTitleLayout->getGlobalTop() + shift;
@@ -2087,7 +2203,7 @@ void OpenGLRender::buildSettingsWindow()
                         1.0f, 0.0f, haLeft, vaCenter);
         }
 
-        if (LayoutObject * soundVolumeRowLayout = settingPanelLayout->getChild(loSoundVolume))
+        if (LayoutObject * soundVolumeRowLayout = Layout::getObject(loSoundVolume))
         {
           const float left = soundVolumeRowLayout->getGlobalLeft();
           const float top = soundVolumeRowLayout->getGlobalTop() + shift;
@@ -2107,7 +2223,7 @@ void OpenGLRender::buildSettingsWindow()
           buildTextMesh(left + Layout::settingsPanelRowCaptionIndent, top, width, height, "Sound", 
                         Layout::settingsPanelRowCaptionHeight, textColor, 1.0f, 0.0f, haLeft, vaCenter);
 
-          if (LayoutObject * progressBarLayout = soundVolumeRowLayout->getChild(loSoundProgressBar))
+          if (LayoutObject * progressBarLayout = Layout::getObject(loSoundProgressBar))
           {
             const float left = progressBarLayout->getGlobalLeft();
             const float top = progressBarLayout->getGlobalTop() + shift;
@@ -2123,7 +2239,7 @@ void OpenGLRender::buildSettingsWindow()
           }
         }
 
-        if (LayoutObject * musicVolumeRowLayout = settingPanelLayout->getChild(loMusicVolume))
+        if (LayoutObject * musicVolumeRowLayout = Layout::getObject(loMusicVolume))
         {
           const float left = musicVolumeRowLayout->getGlobalLeft();
           const float top = musicVolumeRowLayout->getGlobalTop() + shift;
@@ -2143,7 +2259,7 @@ void OpenGLRender::buildSettingsWindow()
           buildTextMesh(left + Layout::settingsPanelRowCaptionIndent, top, width, height, "Music", 
                         Layout::settingsPanelRowCaptionHeight, textColor, 1.0f, 0.0f, haLeft, vaCenter);
 
-          if (LayoutObject * progressBarLayout = musicVolumeRowLayout->getChild(loMusicProgressBar))
+          if (LayoutObject * progressBarLayout = Layout::getObject(loMusicProgressBar))
           {
             const float left = progressBarLayout->getGlobalLeft();
             const float top = progressBarLayout->getGlobalTop() + shift;
@@ -2159,7 +2275,7 @@ void OpenGLRender::buildSettingsWindow()
           }
         }
 
-        if (LayoutObject * keyBindingTitleLayout = settingPanelLayout->getChild(loKeyBindingTitle))
+        if (LayoutObject * keyBindingTitleLayout = Layout::getObject(loKeyBindingTitle))
         {
           const float left = keyBindingTitleLayout->getGlobalLeft();
           const float top = keyBindingTitleLayout->getGlobalTop() + shift;
@@ -2168,7 +2284,7 @@ void OpenGLRender::buildSettingsWindow()
           buildTextMesh(left, top, width, height, "KEY BINDING", height, Palette::settingsPanelTitleText, 1.0f, 0.0f, haLeft, vaCenter);
         }
 
-        if (LayoutObject * keyBindingGridLayout = settingPanelLayout->getChild(loKeyBindingGrid))
+        if (LayoutObject * keyBindingGridLayout = Layout::getObject(loKeyBindingGrid))
         {
           const int selectedRow =
             InterfaceLogic::settingsLogic.selectedControl == SettingsLogic::ctrlKeyBindTable ?
@@ -2208,7 +2324,7 @@ void OpenGLRender::buildSettingsWindow()
         }
       }
 
-      if (LayoutObject * backButtonLayout = settingsWindowLayout->getChild(loSettingsBackButton))
+      if (LayoutObject * backButtonLayout = Layout::getObject(loSettingsBackButton))
       {
         for (int column = 0, count = backButtonLayout->getColumnCount(); column < count; column++)
         {
@@ -2230,9 +2346,11 @@ void OpenGLRender::buildSettingsWindow()
 
 void OpenGLRender::buildLeaderboardWindow()
 {
-  if (LayoutObject * leaderboardLayout = Layout::screen.getChild(loLeaderboard))
+  PROFILE_SCOPE("OpenGLRender::buildLeaderboardWindow");
+  BuilderStatsScope builderStats(*this, sbLeaderboardWindow);
+  if (Layout::getObject(loLeaderboard))
   {
-    if (LayoutObject * leaderboardWindowLayout = leaderboardLayout->getChild(loLeaderboardWindow))
+    if (LayoutObject * leaderboardWindowLayout = Layout::getObject(loLeaderboardWindow))
     {
       const float opProgress = 1.0f - InterfaceLogic::leaderboardLogic.transitionProgress;
       const float sqOpProgress = opProgress * opProgress;
@@ -2248,7 +2366,7 @@ void OpenGLRender::buildLeaderboardWindow()
                   Layout::leaderboardGlowWidth, Palette::leaderboardBackgroundTop, 
                   Palette::leaderboardBackgroundBottom, Palette::leaderboardGlow);
 
-      if (LayoutObject * settingTitleShadowLayout = leaderboardWindowLayout->getChild(loLeaderboardTitleShadow))
+      if (LayoutObject * settingTitleShadowLayout = Layout::getObject(loLeaderboardTitleShadow))
       {
         const float left = settingTitleShadowLayout->getGlobalLeft();
         const float top = settingTitleShadowLayout->getGlobalTop() + shift;
@@ -2259,7 +2377,7 @@ void OpenGLRender::buildLeaderboardWindow()
                       Palette::leaderboardTitleShadowBlur, haLeft, vaTop);
       }
 
-      if (LayoutObject * settingTitleLayout = leaderboardWindowLayout->getChild(loLeaderboardTitle))
+      if (LayoutObject * settingTitleLayout = Layout::getObject(loLeaderboardTitle))
       {
         const float left = settingTitleLayout->getGlobalLeft();
         const float top = settingTitleLayout->getGlobalTop() + shift;
@@ -2269,7 +2387,7 @@ void OpenGLRender::buildLeaderboardWindow()
                       Palette::leaderboardTitleText, 1.0f, 0.0f, haLeft, vaTop);
       }
 
-      if (LayoutObject * settingPanelLayout = leaderboardWindowLayout->getChild(loLeaderboardPanel))
+      if (LayoutObject * settingPanelLayout = Layout::getObject(loLeaderboardPanel))
       {
         const float left = settingPanelLayout->getGlobalLeft();
         const float top = settingPanelLayout->getGlobalTop() + shift;
@@ -2346,7 +2464,7 @@ void OpenGLRender::buildLeaderboardWindow()
         }
       }
 
-      if (LayoutObject * backButtonLayout = leaderboardWindowLayout->getChild(loLeaderboardBackButton))
+      if (LayoutObject * backButtonLayout = Layout::getObject(loLeaderboardBackButton))
       {
         for (int column = 0, count = backButtonLayout->getColumnCount(); column < count; column++)
         {
@@ -2368,7 +2486,9 @@ void OpenGLRender::buildLeaderboardWindow()
 
 void OpenGLRender::buildCountdown()
 {
-  if (LayoutObject * fieldLayout = Layout::screen.getChildRecursive(loField))
+  PROFILE_SCOPE("OpenGLRender::buildCountdown");
+  BuilderStatsScope builderStats(*this, sbCountdown);
+  if (LayoutObject * fieldLayout = Layout::getObject(loField))
   {
     const float xpos = fieldLayout->getGlobalLeft() + 0.5f * fieldLayout->width;
     const float ypos = fieldLayout->getGlobalTop() + 0.5f * fieldLayout->height;
@@ -2397,7 +2517,9 @@ void OpenGLRender::buildCountdown()
 
 void OpenGLRender::buildLevelUp()
 {
-  if (LayoutObject * fieldLayout = Layout::screen.getChildRecursive(loField))
+  PROFILE_SCOPE("OpenGLRender::buildLevelUp");
+  BuilderStatsScope builderStats(*this, sbLevelUp);
+  if (LayoutObject * fieldLayout = Layout::getObject(loField))
   {
     const float effectTime = 2.0f;
     const float magnifTime = 0.5f;
@@ -2438,7 +2560,9 @@ void OpenGLRender::buildLevelUp()
 
 void OpenGLRender::buildDropPredictor()
 {
-  if (LayoutObject * fieldLayout = Layout::screen.getChildRecursive(loField))
+  PROFILE_SCOPE("OpenGLRender::buildDropPredictor");
+  BuilderStatsScope builderStats(*this, sbDropPredictor);
+  if (LayoutObject * fieldLayout = Layout::getObject(loField))
   {
     const float fieldLeft = fieldLayout->getGlobalLeft();
     const float fieldTop = fieldLayout->getGlobalTop();
@@ -2679,6 +2803,8 @@ void OpenGLRender::buildDropPredictor()
 
 void OpenGLRender::updateGameLayer()
 {
+  PROFILE_SCOPE("OpenGLRender::updateGameLayer");
+  statsLayer = slGame;
   clearVertices();
   buildBackground();
 
@@ -2717,7 +2843,7 @@ void OpenGLRender::updateGameLayer()
     buildRect(0.0f, 0.0f, 1.0f, 1.0f, glm::vec3(0.0f), Palette::backgroundShadeAlpha * opPowInProgress);
     drawMesh();
 
-    if (LayoutObject * gameLayout = Layout::screen.getChild(loGame))
+    if (LayoutObject * gameLayout = Layout::getObject(loGame))
     {
       const float xpos = gameLayout->getGlobalLeft() + 0.5f * gameLayout->width;
       const float ypos = gameLayout->getGlobalTop() + 0.5f * gameLayout->height;
@@ -2739,6 +2865,8 @@ void OpenGLRender::updateGameLayer()
 
 void OpenGLRender::updateSettingsLayer()
 {
+  PROFILE_SCOPE("OpenGLRender::updateSettingsLayer");
+  statsLayer = slSettings;
   if (InterfaceLogic::state == InterfaceLogic::stSettings)
   {
     clearVertices();
@@ -2749,7 +2877,6 @@ void OpenGLRender::updateSettingsLayer()
     buildSettingsWindow();
     drawMesh();
 
-    static float keyBindBkShade = 0.0f;
     const float keyBindBkShadingSpeed = 5.0f;
 
     if (InterfaceLogic::settingsLogic.state == SettingsLogic::stKeyWaiting)
@@ -2764,9 +2891,9 @@ void OpenGLRender::updateSettingsLayer()
 
       clearVertices();
 
-      if (LayoutObject * settingsLayout = Layout::screen.getChild(loSettings))
+      if (Layout::getObject(loSettings))
       {
-        if (LayoutObject * bindingMsgLayout = settingsLayout->getChild(loBindingMessage))
+        if (LayoutObject * bindingMsgLayout = Layout::getObject(loBindingMessage))
         {
           const float left = bindingMsgLayout->getGlobalLeft();
           const float top = bindingMsgLayout->getGlobalTop();
@@ -2793,6 +2920,8 @@ void OpenGLRender::updateSettingsLayer()
 
 void OpenGLRender::updateLeaderboardLayer()
 {
+  PROFILE_SCOPE("OpenGLRender::updateLeaderboardLayer");
+  statsLayer = slLeaderboard;
   if (InterfaceLogic::state == InterfaceLogic::stLeaderboard)
   {
     clearVertices();
@@ -2808,6 +2937,8 @@ void OpenGLRender::updateLeaderboardLayer()
 
 void OpenGLRender::updateMenuLayer()
 {
+  PROFILE_SCOPE("OpenGLRender::updateMenuLayer");
+  statsLayer = slMenu;
   MenuLogic * menuLogic = NULL;
   LayoutObject * menuLayout = NULL;
   float shadeProgress = 0.0f;
@@ -2816,37 +2947,37 @@ void OpenGLRender::updateMenuLayer()
   {
   case InterfaceLogic::stMainMenu:
     menuLogic = &InterfaceLogic::mainMenu;
-    menuLayout = Layout::screen.getChild(loMainMenu);
+    menuLayout = Layout::getObject(loMainMenu);
     shadeProgress = InterfaceLogic::menuShadeProgress;
     break;
 
   case InterfaceLogic::stInGameMenu:
     menuLogic = &InterfaceLogic::inGameMenu;
-    menuLayout = Layout::screen.getChild(loInGameMenu);
+    menuLayout = Layout::getObject(loInGameMenu);
     shadeProgress = InterfaceLogic::menuShadeProgress;
     break;
 
   case InterfaceLogic::stQuitConfirmation:
     menuLogic = &InterfaceLogic::quitConfirmationMenu;
-    menuLayout = Layout::screen.getChild(loQuitConfirmationMenu);
+    menuLayout = Layout::getObject(loQuitConfirmationMenu);
     shadeProgress = InterfaceLogic::menuShadeProgress;
     break;
 
   case InterfaceLogic::stRestartConfirmation:
     menuLogic = &InterfaceLogic::restartConfirmationMenu;
-    menuLayout = Layout::screen.getChild(loRestartConfirmationMenu);
+    menuLayout = Layout::getObject(loRestartConfirmationMenu);
     shadeProgress = InterfaceLogic::menuShadeProgress;
     break;
 
   case InterfaceLogic::stExitToMainConfirmation:
     menuLogic = &InterfaceLogic::exitToMainConfirmationMenu;
-    menuLayout = Layout::screen.getChild(loExitToMainConfirmationMenu);
+    menuLayout = Layout::getObject(loExitToMainConfirmationMenu);
     shadeProgress = InterfaceLogic::menuShadeProgress;
     break;
 
   case InterfaceLogic::stSettings: 
     menuLogic = &InterfaceLogic::settingsLogic.saveConfirmationMenu;
-    menuLayout = Layout::screen.getChild(loSaveSettingsMenu);
+    menuLayout = Layout::getObject(loSaveSettingsMenu);
     shadeProgress = InterfaceLogic::settingsLogic.saveConfirmationMenu.transitionProgress;
     break;
 
@@ -2871,3 +3002,403 @@ void OpenGLRender::updateMenuLayer()
   }
 }
 
+
+void OpenGLRender::updateOverlayLayer()
+{
+  if (!fpsCounter && !statsEnabled)
+    return;
+
+  PROFILE_SCOPE("OpenGLRender::updateOverlayLayer");
+  statsLayer = slOverlay;
+  const float left = Layout::backgroundLeft + 0.01f;
+  float top = Layout::backgroundTop + 0.01f;
+
+  clearVertices();
+
+  if (fpsCounter)
+    top += buildFrameGraph(left, top) + 0.01f;
+
+  if (statsEnabled)
+    buildStatsText(left, top);
+
+  drawMesh();
+}
+
+
+float OpenGLRender::buildFrameGraph(float left, float top)
+{
+  const float width = 0.3f;
+  const float height = 0.08f;
+  const float textHeight = 0.02f;
+  const float barWidth = width / FpsCounter::recentCount;
+  // three frame budgets fill the graph height
+  const float budget = fpsCounter->getBudget();
+  const float timeScale = height / (3.0f * budget);
+
+  buildRect(left, top, width, height + textHeight * 1.5f, glm::vec3(0.0f), 0.6f);
+
+  for (int i = 0; i < FpsCounter::recentCount; i++)
+  {
+    const float frameTime = fpsCounter->getRecentFrameTime(i);
+    const float barHeight = glm::min(frameTime * timeScale, height);
+    const glm::vec3 color = frameTime > 2.5f * budget ? glm::vec3(1.0f, 0.2f, 0.2f) :
+                            frameTime > 1.5f * budget ? glm::vec3(1.0f, 0.8f, 0.2f) :
+                                                        glm::vec3(0.3f, 0.9f, 0.3f);
+    buildRect(left + width - (i + 1) * barWidth, top + height - barHeight, barWidth, barHeight, color, 0.8f);
+  }
+
+  buildRect(left, top + height - budget * timeScale, width, pxSize, glm::vec3(1.0f), 0.5f);
+
+  const FpsCounter::Stats & stats = fpsCounter->getStats();
+  char str[128];
+  // the font has letters and digits only
+  Crosy::snprintf(str, sizeof(str), "p50 %d  p95 %d  p99 %d  max %d usec  late %d",
+                  int(stats.getPercentile(0.5f) * 1000000), int(stats.getPercentile(0.95f) * 1000000),
+                  int(stats.getPercentile(0.99f) * 1000000), int(stats.maxFrameTime * 1000000),
+                  stats.overBudgetCount);
+  buildTextMesh(left + 0.005f, top + height, width, textHeight * 1.5f, str, textHeight, glm::vec3(1.0f), 1.0f, 0.0f,
+                haLeft, vaCenter);
+
+  return height + textHeight * 1.5f;
+}
+
+
+// counters of the previous frame, the current one is not complete yet
+float OpenGLRender::buildStatsText(float left, float top)
+{
+  enum { maxLineCount = 1 + STATS_LAYER_COUNT + STATS_BUILDER_COUNT };
+  enum { lineSize = 128 };
+  const float width = 0.55f;
+  const float lineHeight = 0.018f;
+  const float textHeight = 0.014f;
+  const FrameStats & stats = lastFrameStats;
+  char lines[maxLineCount][lineSize];
+  int lineCount = 0;
+
+  Crosy::snprintf(lines[lineCount++], lineSize, "draws %d  verts %d  kb %d  peak kb %d", int(stats.getDrawCalls()),
+                  int(stats.getVertices()), int(stats.getUploadBytes() / 1024),
+                  int(heaviestFrameStats.getUploadBytes() / 1024));
+
+  for (int i = 0; i < STATS_LAYER_COUNT; i++)
+  {
+    const LayerStats & layer = stats.layers[i];
+
+    if (layer.drawCalls)
+    {
+      Crosy::snprintf(lines[lineCount], lineSize, "%s  draws %d  bk %d  atlas %d  text %d  kb %d",
+                      statsLayerNames[i], int(layer.drawCalls), int(layer.vertices[vbBk]),
+                      int(layer.vertices[vbAtlas]), int(layer.vertices[vbText]), int(layer.uploadBytes / 1024));
+
+      if (gpuTimersEnabled)
+      {
+        const size_t length = strlen(lines[lineCount]);
+        Crosy::snprintf(lines[lineCount] + length, lineSize - length, "  gpu %d usec", int(lastGpuTimes[i] / 1000));
+      }
+
+      lineCount++;
+    }
+  }
+
+  for (int i = 0; i < STATS_BUILDER_COUNT; i++)
+  {
+    const uint64_t * vertices = stats.builderVertices[i];
+
+    if (vertices[vbBk] + vertices[vbAtlas] + vertices[vbText])
+      Crosy::snprintf(lines[lineCount++], lineSize, "  %s  bk %d  atlas %d  text %d", statsBuilderNames[i],
+                      int(vertices[vbBk]), int(vertices[vbAtlas]), int(vertices[vbText]));
+  }
+
+  const float height = lineCount * lineHeight + 0.005f;
+  buildRect(left, top, width, height, glm::vec3(0.0f), 0.6f);
+
+  for (int i = 0; i < lineCount; i++)
+    buildTextMesh(left + 0.005f, top + i * lineHeight, width, lineHeight, lines[i], textHeight, glm::vec3(1.0f),
+                  1.0f, 0.0f, haLeft, vaCenter);
+
+  return height;
+}
+
+
+void OpenGLRender::finishFrameStats()
+{
+  lastFrameStats = frameStats;
+  sumStats.add(frameStats);
+  peakStats.setMax(frameStats);
+
+  if (frameStats.getUploadBytes() > heaviestFrameStats.getUploadBytes())
+    heaviestFrameStats = frameStats;
+
+  statsFrameCount++;
+  frameStats.clear();
+}
+
+
+void OpenGLRender::printStats() const
+{
+  if (gpuTimersEnabled && gpuFrameCount)
+  {
+    printf("GPU time, %d frames read, %d dropped as not ready (usec, average / peak):\n", int(gpuFrameCount),
+           gpuMissedCount);
+
+    for (int i = 0; i < STATS_LAYER_COUNT; i++)
+      printf("  %-20s %8.1f / %.1f\n", statsLayerNames[i], sumGpuTimes[i] / 1000.0 / gpuFrameCount,
+             peakGpuTimes[i] / 1000.0);
+  }
+
+  if (!statsEnabled || !statsFrameCount)
+    return;
+
+  const double frames = double(statsFrameCount);
+  printf("Render stats, %d frames, average / peak per frame:\n", int(statsFrameCount));
+  printf("  %-20s %15s %15s %15s %15s %15s\n", "layer", "draws", "bk verts", "atlas verts", "text verts", "KB uploaded");
+
+  for (int i = 0; i < STATS_LAYER_COUNT; i++)
+  {
+    const LayerStats & sum = sumStats.layers[i];
+    const LayerStats & peak = peakStats.layers[i];
+    printf("  %-20s %8.1f / %-4d %8.1f / %-4d %8.1f / %-4d %8.1f / %-4d %8.1f / %-4d\n", statsLayerNames[i],
+           sum.drawCalls / frames, int(peak.drawCalls), sum.vertices[vbBk] / frames, int(peak.vertices[vbBk]),
+           sum.vertices[vbAtlas] / frames, int(peak.vertices[vbAtlas]), sum.vertices[vbText] / frames,
+           int(peak.vertices[vbText]), sum.uploadBytes / frames / 1024, int(peak.uploadBytes / 1024));
+  }
+
+  printf("  %-20s %15s %15s %15s %15s\n", "builder", "", "bk verts", "atlas verts", "text verts");
+
+  for (int i = 0; i < STATS_BUILDER_COUNT; i++)
+  {
+    const uint64_t * sum = sumStats.builderVertices[i];
+    const uint64_t * peak = peakStats.builderVertices[i];
+    printf("  %-20s %15s %8.1f / %-4d %8.1f / %-4d %8.1f / %-4d\n", statsBuilderNames[i], "",
+           sum[vbBk] / frames, int(peak[vbBk]), sum[vbAtlas] / frames, int(peak[vbAtlas]),
+           sum[vbText] / frames, int(peak[vbText]));
+  }
+
+  const FrameStats & heaviest = heaviestFrameStats;
+  printf("Heaviest frame: %d draws, %d verts, %d KB uploaded\n", int(heaviest.getDrawCalls()),
+         int(heaviest.getVertices()), int(heaviest.getUploadBytes() / 1024));
+
+  for (int i = 0; i < STATS_LAYER_COUNT; i++)
+    if (heaviest.layers[i].drawCalls)
+      printf("  %-20s %d draws, %d / %d / %d verts, %d KB\n", statsLayerNames[i], int(heaviest.layers[i].drawCalls),
+             int(heaviest.layers[i].vertices[vbBk]), int(heaviest.layers[i].vertices[vbAtlas]),
+             int(heaviest.layers[i].vertices[vbText]), int(heaviest.layers[i].uploadBytes / 1024));
+
+  for (int i = 0; i < STATS_BUILDER_COUNT; i++)
+  {
+    const uint64_t * vertices = heaviest.builderVertices[i];
+
+    if (vertices[vbBk] + vertices[vbAtlas] + vertices[vbText])
+      printf("  %-20s %d / %d / %d verts\n", statsBuilderNames[i], int(vertices[vbBk]), int(vertices[vbAtlas]),
+             int(vertices[vbText]));
+  }
+}
+
+
+void OpenGLRender::initGpuTimers()
+{
+  gpuTimersEnabled = (getenv("GPU_TIMERS") != NULL || getenv("PROFILER") != NULL);
+
+  if (!gpuTimersEnabled)
+    return;
+
+  if (!GLEW_VERSION_3_3 && !GLEW_ARB_timer_query)
+  {
+    std::cout << "GPU timers: GL_ARB_timer_query is not supported\n";
+    gpuTimersEnabled = false;
+    return;
+  }
+
+  glGenQueries(gpuTimerLatency * STATS_LAYER_COUNT, &gpuQueryIds[0][0]);
+  assert(!checkGlErrors());
+}
+
+
+void OpenGLRender::quitGpuTimers()
+{
+  if (!gpuTimersEnabled)
+    return;
+
+  glDeleteQueries(gpuTimerLatency * STATS_LAYER_COUNT, &gpuQueryIds[0][0]);
+  assert(!checkGlErrors());
+}
+
+
+// ends the query of the previous layer, only one GL_TIME_ELAPSED query can be active
+void OpenGLRender::beginGpuTimer(StatsLayer layer)
+{
+  if (!gpuTimersEnabled)
+    return;
+
+  endGpuTimer();
+  glBeginQuery(GL_TIME_ELAPSED, gpuQueryIds[gpuQueryFrame][layer]);
+  assert(!checkGlErrors());
+  gpuQueryIssued[gpuQueryFrame][layer] = true;
+  gpuQueryCounters[gpuQueryFrame][layer] = Crosy::getPerformanceCounter();
+  activeGpuQuery = layer;
+}
+
+
+void OpenGLRender::endGpuTimer()
+{
+  if (activeGpuQuery < 0)
+    return;
+
+  glEndQuery(GL_TIME_ELAPSED);
+  assert(!checkGlErrors());
+  activeGpuQuery = -1;
+}
+
+
+// results of the frame issued gpuTimerLatency frames ago, its queries are reused in this frame
+void OpenGLRender::readGpuTimers()
+{
+  if (!gpuTimersEnabled)
+    return;
+
+  uint64_t times[STATS_LAYER_COUNT];
+  bool complete = true;
+
+  for (int i = 0; i < STATS_LAYER_COUNT; i++)
+  {
+    times[i] = 0;
+
+    if (!gpuQueryIssued[gpuQueryFrame][i])
+      continue;
+
+    gpuQueryIssued[gpuQueryFrame][i] = false;
+    GLint available = 0;
+    glGetQueryObjectiv(gpuQueryIds[gpuQueryFrame][i], GL_QUERY_RESULT_AVAILABLE, &available);
+    assert(!checkGlErrors());
+
+    if (!available)
+    {
+      complete = false;
+      continue;
+    }
+
+    GLuint64 time = 0;
+    glGetQueryObjectui64v(gpuQueryIds[gpuQueryFrame][i], GL_QUERY_RESULT, &time);
+    assert(!checkGlErrors());
+    times[i] = time;
+  }
+
+  // a late frame is dropped rather than waited for
+  if (!complete)
+  {
+    gpuMissedCount++;
+    return;
+  }
+
+  const uint64_t freq = Crosy::getPerformanceFrequency();
+
+  for (int i = 0; i < STATS_LAYER_COUNT; i++)
+  {
+    lastGpuTimes[i] = times[i];
+    sumGpuTimes[i] += times[i];
+    peakGpuTimes[i] = glm::max(peakGpuTimes[i], times[i]);
+
+    // the GPU clock is not the CPU one: a layer goes to the trace when it was issued or when the
+    // previous one ended, whatever is later, and takes its GPU time
+    if (times[i])
+    {
+      const uint64_t start = glm::max(gpuQueryCounters[gpuQueryFrame][i], gpuTrackEnd);
+      gpuTrackEnd = start + times[i] * freq / 1000000000;
+      Profiler::recordGpu(gpuTrackNames[i], start, gpuTrackEnd);
+    }
+  }
+
+  gpuFrameCount++;
+}
+
+
+void OpenGLRender::FrameStats::clear()
+{
+  memset(this, 0, sizeof(*this));
+}
+
+
+void OpenGLRender::FrameStats::add(const FrameStats & other)
+{
+  for (int i = 0; i < STATS_LAYER_COUNT; i++)
+  {
+    layers[i].drawCalls += other.layers[i].drawCalls;
+    layers[i].uploadBytes += other.layers[i].uploadBytes;
+
+    for (int j = 0; j < VERTEX_BUFFER_COUNT; j++)
+      layers[i].vertices[j] += other.layers[i].vertices[j];
+  }
+
+  for (int i = 0; i < STATS_BUILDER_COUNT; i++)
+    for (int j = 0; j < VERTEX_BUFFER_COUNT; j++)
+      builderVertices[i][j] += other.builderVertices[i][j];
+}
+
+
+void OpenGLRender::FrameStats::setMax(const FrameStats & other)
+{
+  for (int i = 0; i < STATS_LAYER_COUNT; i++)
+  {
+    layers[i].drawCalls = glm::max(layers[i].drawCalls, other.layers[i].drawCalls);
+    layers[i].uploadBytes = glm::max(layers[i].uploadBytes, other.layers[i].uploadBytes);
+
+    for (int j = 0; j < VERTEX_BUFFER_COUNT; j++)
+      layers[i].vertices[j] = glm::max(layers[i].vertices[j], other.layers[i].vertices[j]);
+  }
+
+  for (int i = 0; i < STATS_BUILDER_COUNT; i++)
+    for (int j = 0; j < VERTEX_BUFFER_COUNT; j++)
+      builderVertices[i][j] = glm::max(builderVertices[i][j], other.builderVertices[i][j]);
+}
+
+
+uint64_t OpenGLRender::FrameStats::getDrawCalls() const
+{
+  uint64_t result = 0;
+
+  for (int i = 0; i < STATS_LAYER_COUNT; i++)
+    result += layers[i].drawCalls;
+
+  return result;
+}
+
+
+uint64_t OpenGLRender::FrameStats::getVertices() const
+{
+  uint64_t result = 0;
+
+  for (int i = 0; i < STATS_LAYER_COUNT; i++)
+    for (int j = 0; j < VERTEX_BUFFER_COUNT; j++)
+      result += layers[i].vertices[j];
+
+  return result;
+}
+
+
+uint64_t OpenGLRender::FrameStats::getUploadBytes() const
+{
+  uint64_t result = 0;
+
+  for (int i = 0; i < STATS_LAYER_COUNT; i++)
+    result += layers[i].uploadBytes;
+
+  return result;
+}
+
+
+OpenGLRender::BuilderStatsScope::BuilderStatsScope(OpenGLRender & render, StatsBuilder builder) :
+  render(render),
+  builder(builder)
+{
+  startSizes[vbBk] = render.bkVertexBuffer.size();
+  startSizes[vbAtlas] = render.atlasVertexBuffer.size();
+  startSizes[vbText] = render.textVertexBuffer.size();
+}
+
+
+OpenGLRender::BuilderStatsScope::~BuilderStatsScope()
+{
+  uint64_t * vertices = render.frameStats.builderVertices[builder];
+  vertices[vbBk] += render.bkVertexBuffer.size() - startSizes[vbBk];
+  vertices[vbAtlas] += render.atlasVertexBuffer.size() - startSizes[vbAtlas];
+  vertices[vbText] += render.textVertexBuffer.size() - startSizes[vbText];
+}
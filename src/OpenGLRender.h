@@ -3,6 +3,7 @@
 #include "Shader.h"
 #include "Cell.h"
 #include "Figure.h"
+#include "FpsCounter.h"
 #include "GameLogic.h"
 #include "InterfaceLogic.h"
 #include "LayoutObject.h"
@@ -12,6 +13,12 @@ class OpenGLRender
 {
 public:
   bool showWireframe;
+  // frame time graph is drawn over everything when set
+  const FpsCounter * fpsCounter;
+  // RENDER_STATS environment variable: draw calls, vertices and uploads on the screen and on exit
+  bool statsEnabled;
+  // GPU_TIMERS or PROFILER environment variable, needs GL_ARB_timer_query
+  bool gpuTimersEnabled;
 
   OpenGLRender();
 
@@ -19,6 +26,8 @@ public:
   void quit();
   void resize(int width, int height);
   void update();
+  bool isAnimating() const;
+  void printStats() const;
 
 private:
 
@@ -73,7 +82,85 @@ private:
     float falloff;
   };
 
+  enum StatsLayer
+  {
+    slGame,
+    slSettings,
+    slLeaderboard,
+    slMenu,
+    slOverlay,
+    STATS_LAYER_COUNT
+  };
+
+  enum StatsBuilder
+  {
+    sbBackground,
+    sbField,
+    sbHoldFigure,
+    sbNextFigures,
+    sbDropTrails,
+    sbRowFlashes,
+    sbDropPredictor,
+    sbCountdown,
+    sbLevelUp,
+    sbMenu,
+    sbSettingsWindow,
+    sbLeaderboardWindow,
+    STATS_BUILDER_COUNT
+  };
+
+  enum VertexBufferIndex
+  {
+    vbBk,
+    vbAtlas,
+    vbText,
+    VERTEX_BUFFER_COUNT
+  };
+
+  struct LayerStats
+  {
+    uint64_t drawCalls;
+    uint64_t vertices[VERTEX_BUFFER_COUNT];
+    uint64_t uploadBytes;
+  };
+
+  // counters of one frame; also used for sums and peaks over frames
+  struct FrameStats
+  {
+    LayerStats layers[STATS_LAYER_COUNT];
+    // vertices added by the builder, including nested builder calls
+    uint64_t builderVertices[STATS_BUILDER_COUNT][VERTEX_BUFFER_COUNT];
+
+    void clear();
+    void add(const FrameStats & other);
+    void setMax(const FrameStats & other);
+    uint64_t getDrawCalls() const;
+    uint64_t getVertices() const;
+    uint64_t getUploadBytes() const;
+  };
+
+  // counts the vertices a builder adds between its construction and destruction
+  class BuilderStatsScope
+  {
+  private:
+    OpenGLRender & render;
+    StatsBuilder builder;
+    size_t startSizes[VERTEX_BUFFER_COUNT];
+
+  public:
+    BuilderStatsScope(OpenGLRender & render, StatsBuilder builder);
+    ~BuilderStatsScope();
+  };
+
+  // GL_TIME_ELAPSED results are read this many frames after they were issued, so reading does not stall
+  enum { gpuTimerLatency = 4 };
+
+  static const char * const statsLayerNames[STATS_LAYER_COUNT];
+  static const char * const gpuTrackNames[STATS_LAYER_COUNT];
+  static const char * const statsBuilderNames[STATS_BUILDER_COUNT];
+
   const float edgeBlurWidth;
+  float keyBindBkShade;
   const int atlasSpriteSize = 64;
   int width;
   int height;
@@ -96,6 +183,26 @@ private:
   std::vector<Vertex> bkVertexBuffer;
   std::vector<Vertex> atlasVertexBuffer;
   std::vector<TextVertex> textVertexBuffer;
+  StatsLayer statsLayer;
+  FrameStats frameStats;
+  FrameStats lastFrameStats;
+  FrameStats sumStats;
+  FrameStats peakStats;
+  // the frame with most bytes uploaded, to compare with the average one
+  FrameStats heaviestFrameStats;
+  uint64_t statsFrameCount;
+  GLuint gpuQueryIds[gpuTimerLatency][STATS_LAYER_COUNT];
+  bool gpuQueryIssued[gpuTimerLatency][STATS_LAYER_COUNT];
+  uint64_t gpuQueryCounters[gpuTimerLatency][STATS_LAYER_COUNT];
+  int gpuQueryFrame;
+  int activeGpuQuery;
+  // nanoseconds per layer: last read frame, sums and peaks
+  uint64_t lastGpuTimes[STATS_LAYER_COUNT];
+  uint64_t sumGpuTimes[STATS_LAYER_COUNT];
+  uint64_t peakGpuTimes[STATS_LAYER_COUNT];
+  uint64_t gpuFrameCount;
+  int gpuMissedCount;
+  uint64_t gpuTrackEnd;
 
   void clearVertices();
   void drawMesh();
@@ -154,4 +261,13 @@ private:
   void updateSettingsLayer();
   void updateLeaderboardLayer();
   void updateMenuLayer();
+  void updateOverlayLayer();
+  float buildFrameGraph(float left, float top);
+  float buildStatsText(float left, float top);
+  void finishFrameStats();
+  void initGpuTimers();
+  void quitGpuTimers();
+  void beginGpuTimer(StatsLayer layer);
+  void endGpuTimer();
+  void readGpuTimers();
 };
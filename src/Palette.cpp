@@ -1,7 +1,7 @@
 #include "static_headers.h"
 
 #include "Palette.h"
-#include "Crosy.h"
+#include "AssetPack.h"
 
 glm::vec3 Palette::gameBackgroundOuter(0.05f, 0.1f, 0.2f);
 glm::vec3 Palette::gameBackgroundInner(0.3f, 0.6f, 1.0f);
@@ -96,14 +96,9 @@ float Palette::fieldBackgroundInnerBright = 0.25f;
 void Palette::load(const char * name)
 {
   rapidjson::Document doc;
-  std::string fileName = Crosy::getExePath() + "/palettes/" + name + ".json";
-  FILE * file = fopen(fileName.c_str(), "rb");
-  assert(file);
-  const int bufSize = 16384;
-  static char buf[bufSize];
-  rapidjson::FileReadStream frstream(file, buf, bufSize);
-  doc.ParseStream<rapidjson::FileReadStream>(frstream);
-  fclose(file);
+  std::string fileName = std::string("palettes/") + name + ".json";
+  bool loaded = AssetPack::loadJson(fileName.c_str(), doc);
+  assert(loaded);
 
   loadValue(doc, "GameBackgroundOuter", &gameBackgroundOuter);
   loadValue(doc, "GameBackgroundInner", &gameBackgroundInner);
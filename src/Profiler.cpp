@@ -0,0 +1,137 @@
+#include "static_headers.h"
+
+#include "Profiler.h"
+#include <stdlib.h>
+
+std::mutex Profiler::ringsMutex;
+std::vector<Profiler::ThreadRing *> Profiler::rings;
+thread_local Profiler::ThreadRing * Profiler::threadRing = NULL;
+Profiler::ThreadRing * Profiler::gpuRing = NULL;
+int Profiler::dumpCount = 0;
+uint64_t Profiler::initCounter = 0;
+bool Profiler::enabled = false;
+
+
+void Profiler::init()
+{
+  enabled = (getenv("PROFILER") != NULL);
+  initCounter = Crosy::getPerformanceCounter();
+
+  if (enabled)
+    setThreadName("main");
+}
+
+
+void Profiler::quit()
+{
+  if (enabled)
+    dump();
+
+  enabled = false;
+  std::lock_guard<std::mutex> lock(ringsMutex);
+
+  // threads that recorded scopes have been stopped by now
+  for (ThreadRing * ring : rings)
+    delete ring;
+
+  rings.clear();
+  threadRing = NULL;
+  gpuRing = NULL;
+}
+
+
+Profiler::ThreadRing * Profiler::createRing(const char * threadName)
+{
+  ThreadRing * ring = new ThreadRing;
+  ring->head.store(0, std::memory_order_relaxed);
+
+  std::lock_guard<std::mutex> lock(ringsMutex);
+  ring->threadId = int(rings.size()) + 1;
+  ring->threadName = threadName ? threadName : "thread " + std::to_string(ring->threadId);
+  rings.push_back(ring);
+
+  return ring;
+}
+
+
+void Profiler::setThreadName(const char * threadName)
+{
+  if (!threadRing)
+    threadRing = createRing(threadName);
+  else
+  {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    threadRing->threadName = threadName;
+  }
+}
+
+
+void Profiler::recordGpu(const char * name, uint64_t start, uint64_t end)
+{
+  if (!enabled)
+    return;
+
+  if (!gpuRing)
+    gpuRing = createRing("gpu");
+
+  write(gpuRing, name, start, end);
+}
+
+
+void Profiler::dump()
+{
+  if (!enabled)
+    return;
+
+  const std::string fileName = Crosy::getExePath() + "profile_" + std::to_string(++dumpCount) + ".json";
+  FILE * file = fopen(fileName.c_str(), "wb");
+
+  if (!file)
+  {
+    std::cout << "Profiler: cannot create " << fileName << "\n";
+    return;
+  }
+
+  const double usecPerCount = 1000000.0 / Crosy::getPerformanceFrequency();
+  std::vector<Scope> scopes;
+  scopes.reserve(ringSize);
+  int scopeCount = 0;
+  bool first = true;
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  std::lock_guard<std::mutex> lock(ringsMutex);
+
+  for (ThreadRing * ring : rings)
+  {
+    fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", ring->threadId, ring->threadName.c_str());
+    first = false;
+
+    // the owner keeps writing while the ring is copied, scopes it may have overwritten are dropped
+    const uint64_t head = ring->head.load(std::memory_order_acquire);
+    const uint64_t begin = head > ringSize ? head - ringSize : 0;
+    scopes.clear();
+
+    for (uint64_t i = begin; i < head; i++)
+      scopes.push_back(ring->scopes[i & (ringSize - 1)]);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t newHead = ring->head.load(std::memory_order_relaxed);
+    const uint64_t validBegin = newHead >= ringSize ? newHead - ringSize + 1 : 0;
+    const size_t skip = size_t(glm::min(glm::max(validBegin, begin) - begin, head - begin));
+
+    for (size_t i = skip; i < scopes.size(); i++)
+    {
+      const Scope & scope = scopes[i];
+      fprintf(file, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+              scope.name, ring->threadId, double(int64_t(scope.start - initCounter)) * usecPerCount,
+              double(scope.end - scope.start) * usecPerCount);
+    }
+
+    scopeCount += int(scopes.size() - skip);
+  }
+
+  fprintf(file, "\n]}\n");
+  fclose(file);
+  std::cout << "Profiler: " << scopeCount << " scopes written to " << fileName << "\n";
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Crosy.h"
+#include <atomic>
+
+// CPU scope profiler, enabled by PROFILER environment variable. PROFILE_SCOPE stamps the
+// start and the end of the enclosing block into a ring of the calling thread; only the
+// owner thread writes its ring, so recording takes no locks. dump() writes the last
+// ringSize scopes of every thread as Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+// to profile_<n>.json next to the executable; it runs on F12 and on exit. GPU times of the
+// render layers go to a separate "gpu" track, see recordGpu.
+class Profiler
+{
+private:
+  Profiler();
+  ~Profiler();
+
+  struct Scope
+  {
+    const char * name;
+    uint64_t start;
+    uint64_t end;
+  };
+
+  enum { ringSize = 1 << 16 };
+
+  struct ThreadRing
+  {
+    std::string threadName;
+    int threadId;
+    // scopes written so far, the last ringSize of them are in the ring
+    std::atomic<uint64_t> head;
+    Scope scopes[ringSize];
+  };
+
+  static std::mutex ringsMutex;
+  static std::vector<ThreadRing *> rings;
+  static thread_local ThreadRing * threadRing;
+  static ThreadRing * gpuRing;
+  static int dumpCount;
+  static uint64_t initCounter;
+
+  static ThreadRing * createRing(const char * threadName);
+
+public:
+  static bool enabled;
+
+  static void init();
+  static void quit();
+  static void setThreadName(const char * threadName);
+  static void dump();
+
+  static void record(const char * name, uint64_t start, uint64_t end)
+  {
+    if (!threadRing)
+      threadRing = createRing(NULL);
+
+    write(threadRing, name, start, end);
+  }
+
+  // for the render thread only; start and end are in performance counter units like CPU scopes
+  static void recordGpu(const char * name, uint64_t start, uint64_t end);
+
+private:
+  static void write(ThreadRing * ring, const char * name, uint64_t start, uint64_t end)
+  {
+    const uint64_t head = ring->head.load(std::memory_order_relaxed);
+    Scope & scope = ring->scopes[head & (ringSize - 1)];
+    scope.name = name;
+    scope.start = start;
+    scope.end = end;
+    ring->head.store(head + 1, std::memory_order_release);
+  }
+};
+
+
+class ProfileScope
+{
+private:
+  const char * name;
+  uint64_t start;
+
+public:
+  ProfileScope(const char * name) :
+    name(name),
+    start(Profiler::enabled ? Crosy::getPerformanceCounter() : 0)
+  {
+  }
+
+  ~ProfileScope()
+  {
+    if (start)
+      Profiler::record(name, start, Crosy::getPerformanceCounter());
+  }
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+// name must be a string literal or live as long as the program
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
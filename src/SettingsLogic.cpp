@@ -2,6 +2,7 @@
 
 #include "SettingsLogic.h"
 #include "Globals.h"
+#include "GameEvents.h"
 #include "Time.h"
 #include "Crosy.h"
 
@@ -69,6 +70,7 @@ SettingsLogic::Result SettingsLogic::update()
       break;
     case stHidden:
       state = stShowing;
+      GameEvents::push(GameEvents::evMenuShowing);
       break;
     case stSaveConfirmation:
       saveConfirmationUpdate();
@@ -113,7 +115,10 @@ void SettingsLogic::escape()
   if (changed)
     state = stSaveConfirmation;
   else
+  {
     state = stHiding;
+    GameEvents::push(GameEvents::evMenuHiding);
+  }
 }
 
 
@@ -185,6 +190,9 @@ void SettingsLogic::save()
 
 void SettingsLogic::setSoundVolume(float volume)
 {
+  if (volume != soundVolume)
+    GameEvents::push(GameEvents::evSoundVolume);
+
   soundVolume = volume;
   changed = true;
 }
@@ -192,11 +200,21 @@ void SettingsLogic::setSoundVolume(float volume)
 
 void SettingsLogic::setMusicVolume(float volume)
 {
+  if (volume != musicVolume)
+    GameEvents::push(GameEvents::evMusicVolume);
+
   musicVolume = volume;
   changed = true;
 }
 
 
+void SettingsLogic::waitForKey()
+{
+  state = stKeyWaiting;
+  GameEvents::push(GameEvents::evKeyWaiting);
+}
+
+
 void SettingsLogic::setCurrentActionKey(Key key)
 {
   assert(selectedControl == ctrlKeyBindTable);
@@ -229,6 +247,7 @@ void SettingsLogic::saveAndExit()
 {
   save();
   state = stHiding;
+  GameEvents::push(GameEvents::evMenuHiding);
 }
 
 
@@ -236,6 +255,8 @@ void SettingsLogic::cancelAndExit()
 {
   load();
   state = stHiding;
+  GameEvents::push(GameEvents::evMusicVolume);
+  GameEvents::push(GameEvents::evMenuHiding);
 }
 
 
@@ -68,6 +68,7 @@ public:
   void setSoundVolume(float volume);
   void setMusicVolume(float volume);
   void setCurrentActionKey(Key key);
+  void waitForKey();
   float getSoundVolume();
   float getMusicVolume();
   Key getKeyBind(Binding::Action action);
@@ -1,44 +1,49 @@
 #include "static_headers.h"
 
 #include "GameLogic.h"
+#include "GameEvents.h"
 #include "InterfaceLogic.h"
 #include "Sound.h"
 #include "Crosy.h"
 #include "Globals.h"
+#include "Profiler.h"
 #include "Time.h"
+#include "AssetPack.h"
 
 FMOD::System * Sound::system = NULL;
 FMOD::Sound * Sound::samples[SAMPLE_COUNT];
 FMOD::Channel * Sound::musicChannel = NULL;
 FMOD::Channel * Sound::soundChannel = NULL;
+FMOD::SoundGroup * Sound::moveGroup = NULL;
+// FMOD priorities, lower is more important: a busy mixer steals voices of cheap repeated
+// move sounds first and never cuts the music or line clears for them
+const int Sound::samplePriorities[SAMPLE_COUNT] = 
+{
+  64,  // smpDrop
+  192, // smpLeft
+  192, // smpRight
+  128, // smpHold
+  192, // smpDown
+  32,  // smpWipe
+  64,  // smpCountdown
+  32,  // smpLevelUp
+  160, // smpUiClick
+  160, // smpUiAnimIn
+  160, // smpUiAnimOut
+  0,   // smpMusic
+};
 unsigned int Sound::version = 0;
 void * Sound::extradriverdata = NULL;
 bool Sound::initialized = false;
-std::string Sound::soundPath = Crosy::getExePath() + "sounds/";
-int Sound::lastFigureId = 0;
-int Sound::lastFigureX = 0;
-int Sound::lastFigureAngle = 0;
-int Sound::lastHoldFigureId = 0;
-unsigned int Sound::lastFastDownCounter = 0;
-unsigned int Sound::lastDropTrailCounter = 0;
-int Sound::lastDeletedRowsCount = 0;
-int Sound::lastLevel = 0;
-int Sound::lastCountdownTimeLeft = 0;
-GameLogic::State Sound::lastGameState = GameLogic::stStopped;
-MenuLogic::State Sound::lastMainMenuState = MenuLogic::stHidden;
-MenuLogic::State Sound::lastInGameMenuState = MenuLogic::stHidden;
-MenuLogic::State Sound::lastQuitConfirmationMenuState = MenuLogic::stHidden;
-MenuLogic::State Sound::lastRestartConfirmationMenuState = MenuLogic::stHidden;
-MenuLogic::State Sound::lastExitToMainConfirmationMenuState = MenuLogic::stHidden;
-SettingsLogic::State Sound::lastSettingsState = SettingsLogic::stHidden;
-LeaderboardLogic::State Sound::lastLeaderboardState = LeaderboardLogic::stHidden;
-float Sound::lastSoundVolume = 0.0f;
-float Sound::lastMusicVolume = 0.0f;
+int Sound::sampleRate = 0;
+double Sound::scheduleDelay = 0.0;
+double Sound::maxEventAge = 1.0 / 60.0;
+double Sound::bufferTime = 0.0;
+std::string Sound::soundPath = "sounds/";
 
 void Sound::init()
 {
   assert(!initialized);
-  resetLastState();
 
   if (!initialized)
   {
@@ -49,7 +54,12 @@ void Sound::init()
 
     if (result == FMOD_OK)
     {
+#ifdef __linux__
+      // ~17 ms, the mixer doubles the period by itself if the device underruns
+      result = system->setDSPBufferSize(256, 3);
+#else
       result = system->setDSPBufferSize(1024, 2);
+#endif
       assert(result == FMOD_OK);
 
       if (result == FMOD_OK)
@@ -65,42 +75,38 @@ void Sound::init()
 
           if (result == FMOD_OK)
           {
-            result = system->createSound((soundPath + "drop.wav").c_str(), FMOD_DEFAULT, 0, 
-                                         samples + smpDrop);
+            result = setupScheduling();
+            assert(result == FMOD_OK);
+          }
+
+          if (result == FMOD_OK)
+          {
+            result = createSample("drop.wav", FMOD_DEFAULT, samples + smpDrop);
+            assert(result == FMOD_OK);
+            result = createSample("left.wav", FMOD_DEFAULT, samples + smpLeft);
             assert(result == FMOD_OK);
-            result = system->createSound((soundPath + "left.wav").c_str(), FMOD_DEFAULT, 0, 
-                                         samples + smpLeft);
+            result = createSample("right.wav", FMOD_DEFAULT, samples + smpRight);
             assert(result == FMOD_OK);
-            result = system->createSound((soundPath + "right.wav").c_str(), FMOD_DEFAULT, 0, 
-                                         samples + smpRight);
+            result = createSample("hold.wav", FMOD_DEFAULT, samples + smpHold);
             assert(result == FMOD_OK);
-            result = system->createSound((soundPath + "hold.wav").c_str(), FMOD_DEFAULT, 0, 
-                                         samples + smpHold);
+            result = createSample("down.wav", FMOD_DEFAULT, samples + smpDown);
             assert(result == FMOD_OK);
-            result = system->createSound((soundPath + "down.wav").c_str(), FMOD_DEFAULT, 0, 
-                                         samples + smpDown);
+            result = createSample("wipe.wav", FMOD_DEFAULT, samples + smpWipe);
             assert(result == FMOD_OK);
-            result = system->createSound((soundPath + "wipe.wav").c_str(), FMOD_DEFAULT, 0, 
-                                         samples + smpWipe);
+            result = createSample("levelup.wav", FMOD_DEFAULT, samples + smpLevelUp);
             assert(result == FMOD_OK);
-            result = system->createSound((soundPath + "levelup.wav").c_str(), FMOD_DEFAULT, 0, 
-                                         samples + smpLevelUp);
+            result = createSample("countdown.wav", FMOD_DEFAULT, samples + smpCountdown);
             assert(result == FMOD_OK);
-            result = system->createSound((soundPath + "countdown.wav").c_str(), FMOD_DEFAULT, 0, 
-                                         samples + smpCountdown);
+            result = createSample("ui_move.wav", FMOD_DEFAULT, samples + smpUiClick);
             assert(result == FMOD_OK);
-            result = system->createSound((soundPath + "ui_move.wav").c_str(), FMOD_DEFAULT, 0, 
-                                         samples + smpUiClick);
+            result = createSample("ui_enter.wav", FMOD_DEFAULT, samples + smpUiAnimIn);
             assert(result == FMOD_OK);
-            result = system->createSound((soundPath + "ui_enter.wav").c_str(), FMOD_DEFAULT, 0, 
-                                         samples + smpUiAnimIn);
+            result = createSample("ui_move.wav", FMOD_DEFAULT, samples + smpUiAnimOut);
             assert(result == FMOD_OK);
-            result = system->createSound((soundPath + "ui_move.wav").c_str(), FMOD_DEFAULT, 0, 
-                                         samples + smpUiAnimOut);
+            result = createSample("music.mp3", FMOD_DEFAULT | FMOD_CREATESTREAM | FMOD_LOOP_NORMAL, 
+                                  samples + smpMusic);
             assert(result == FMOD_OK);
-            result = system->createSound((soundPath + "music.mp3").c_str(), 
-                                         FMOD_DEFAULT | FMOD_CREATESTREAM | FMOD_LOOP_NORMAL, 
-                                         NULL, samples + smpMusic);
+            result = setupVoiceLimits();
             assert(result == FMOD_OK);
 
             if (result == FMOD_OK)
@@ -125,232 +131,237 @@ void Sound::init()
 
 void Sound::update()
 {
+  PROFILE_SCOPE("Sound::update");
   if (!initialized)
     return;
 
-  if (GameLogic::state != lastGameState)
-  {
-    lastFigureId = GameLogic::curFigure.id;
-    lastFigureX = GameLogic::curFigureX;
-    lastFigureAngle = GameLogic::curFigure.angle;
-    lastHoldFigureId = GameLogic::holdFigure.id;
-    lastFastDownCounter = GameLogic::fastDownCounter;
-    lastDropTrailCounter = GameLogic::dropTrailCounter;
-    lastDeletedRowsCount = GameLogic::getDeletedRowsCount();
-    lastLevel = GameLogic::curLevel;
-    lastGameState = GameLogic::state;
-  }
+  bool levelUp = false;
 
-  if (lastFigureId != GameLogic::curFigure.id)
+  for (int i = 0; i < GameEvents::getCount(); i++)
   {
-    lastFigureId = GameLogic::curFigure.id;
-    lastFigureX = GameLogic::curFigureX;
-    lastFigureAngle = GameLogic::curFigure.angle;
-  }
+    const GameEvents::Event & event = GameEvents::get(i);
 
-  if (GameLogic::curFigureX != lastFigureX)
-  {
-    if (GameLogic::curFigureX < lastFigureX)
-      play(smpLeft);
-    else if (GameLogic::curFigureX > lastFigureX)
-      play(smpRight);
-
-    lastFigureX = GameLogic::curFigureX;
-  }
+    switch (event.type)
+    {
+      case GameEvents::evShiftLeft:
+      case GameEvents::evRotateLeft:
+        play(smpLeft, event.time);
+        break;
+      case GameEvents::evShiftRight:
+      case GameEvents::evRotateRight:
+        play(smpRight, event.time);
+        break;
+      case GameEvents::evHold:
+        play(smpHold, event.time);
+        break;
+      case GameEvents::evFastDown:
+        play(smpDown, event.time);
+        break;
+      case GameEvents::evDrop:
+        play(smpDrop, event.time);
+        break;
+      case GameEvents::evLevelUp:
+        play(smpLevelUp, event.time);
+        levelUp = true;
+        break;
+      case GameEvents::evRowsDeleted:
+        if (!levelUp)
+          play(smpWipe, event.time);
+
+        levelUp = false;
+        break;
+      case GameEvents::evCountdown:
+        play(smpCountdown, event.time);
+        break;
+      case GameEvents::evMenuShowing:
+        play(smpUiAnimIn, event.time);
+        break;
+      case GameEvents::evMenuHiding:
+        play(smpUiAnimOut, event.time);
+        break;
+      case GameEvents::evKeyWaiting:
+        play(smpUiClick, event.time);
+        break;
+      case GameEvents::evSoundVolume:
+        if (InterfaceLogic::settingsLogic.state == SettingsLogic::stVisible)
+        {
+          static double lastPlayedTimer = 0.0;
+          const double replayTime = 0.125;
 
-  if (GameLogic::curFigure.angle != lastFigureAngle)
-  {
-    if (GameLogic::curFigure.angle < lastFigureAngle)
-      play(smpLeft);
-    else if (GameLogic::curFigure.angle > lastFigureAngle)
-      play(smpRight);
+          if (event.time - lastPlayedTimer > replayTime)
+          {
+            play(smpDrop, event.time);
+            lastPlayedTimer = event.time;
+          }
+        }
 
-    lastFigureAngle = GameLogic::curFigure.angle;
-  }
+        break;
+      case GameEvents::evMusicVolume:
+        if (musicChannel)
+          musicChannel->setVolume(InterfaceLogic::settingsLogic.getMusicVolume());
 
-  if (GameLogic::holdFigure.id != lastHoldFigureId)
-  {
-    play(smpHold);
-    lastHoldFigureId = GameLogic::holdFigure.id;
+        break;
+      default:
+        break;
+    }
   }
 
-  if (GameLogic::fastDownCounter != lastFastDownCounter)
-  {
-    play(smpDown);
-    lastFastDownCounter = GameLogic::fastDownCounter;
-  }
+  FMOD_RESULT result = system->update();
+  assert(result == FMOD_OK);
+}
 
-  if (GameLogic::dropTrailCounter > lastDropTrailCounter)
-    play(smpDrop);
 
-  lastDropTrailCounter = GameLogic::dropTrailCounter;
+void Sound::quit()
+{
+  if (!initialized)
+    return;
 
-  if (GameLogic::getDeletedRowsCount() > lastDeletedRowsCount)
-  {
-    if (GameLogic::curLevel > lastLevel)
-      play(smpLevelUp);
-    else
-      play(smpWipe);
-  }
+  initialized = false;
+  FMOD_RESULT result;
 
-  lastDeletedRowsCount = GameLogic::getDeletedRowsCount();
-  lastLevel = GameLogic::curLevel;
+  for (int i = 0; i < SAMPLE_COUNT; i++)
+    if (samples[i])
+    {
+      result = samples[i]->release();
+      assert(result == FMOD_OK);
+      samples[i] = NULL;
+    }
 
-  if (lastCountdownTimeLeft != (int)GameLogic::countdownTimeLeft)
+  if (moveGroup)
   {
-    play(smpCountdown);
-    lastCountdownTimeLeft = (int)GameLogic::countdownTimeLeft;
+    result = moveGroup->release();
+    assert(result == FMOD_OK);
+    moveGroup = NULL;
   }
 
-  if (lastMainMenuState != InterfaceLogic::mainMenu.state)
-  {
-    if (InterfaceLogic::mainMenu.state == MenuLogic::stShowing)
-      play(smpUiAnimIn);
-    else if (InterfaceLogic::mainMenu.state == MenuLogic::stHiding)
-      play(smpUiAnimOut);
-
-    lastMainMenuState = InterfaceLogic::mainMenu.state;
-  }
+  result = system->release();
+  assert(result == FMOD_OK);
+}
 
-  if (lastInGameMenuState != InterfaceLogic::inGameMenu.state)
-  {
-    if (InterfaceLogic::inGameMenu.state == MenuLogic::stShowing)
-      play(smpUiAnimIn);
-    else if (InterfaceLogic::inGameMenu.state == MenuLogic::stHiding)
-      play(smpUiAnimOut);
 
-    lastInGameMenuState = InterfaceLogic::inGameMenu.state;
-  }
+// 'time' is when the event happened, PerfTime::timer units
+void Sound::play(Sample sample, double time)
+{
+  FMOD_RESULT result = system->playSound(samples[sample], 0, true, &soundChannel);
+  assert(result == FMOD_OK);
 
-  if (lastQuitConfirmationMenuState != InterfaceLogic::quitConfirmationMenu.state)
+  if (result == FMOD_OK)
   {
-    if (InterfaceLogic::quitConfirmationMenu.state == MenuLogic::stShowing)
-      play(smpUiAnimIn);
-    else if (InterfaceLogic::quitConfirmationMenu.state == MenuLogic::stHiding)
-      play(smpUiAnimOut);
-
-    lastQuitConfirmationMenuState = InterfaceLogic::quitConfirmationMenu.state;
+    result = soundChannel->setVolume(InterfaceLogic::settingsLogic.getSoundVolume());
+    assert(result == FMOD_OK);
+    result = scheduleStart(soundChannel, time);
+    assert(result == FMOD_OK);
+    result = soundChannel->setPaused(false);
+    assert(result == FMOD_OK);
   }
+}
 
-  if (lastRestartConfirmationMenuState != InterfaceLogic::restartConfirmationMenu.state)
-  {
-    if (InterfaceLogic::restartConfirmationMenu.state == MenuLogic::stShowing)
-      play(smpUiAnimIn);
-    else if (InterfaceLogic::restartConfirmationMenu.state == MenuLogic::stHiding)
-      play(smpUiAnimOut);
 
-    lastRestartConfirmationMenuState = InterfaceLogic::restartConfirmationMenu.state;
-  }
-
-  if (lastExitToMainConfirmationMenuState != InterfaceLogic::exitToMainConfirmationMenu.state)
-  {
-    if (InterfaceLogic::exitToMainConfirmationMenu.state == MenuLogic::stShowing)
-      play(smpUiAnimIn);
-    else if (InterfaceLogic::exitToMainConfirmationMenu.state == MenuLogic::stHiding)
-      play(smpUiAnimOut);
+// Every sound is heard a fixed delay after its event, so frame pacing and the buffer
+// the mixer happens to be in do not shift it. The delay covers one frame between the event
+// and Sound::update plus one buffer before the mixer picks the sound up.
+FMOD_RESULT Sound::setupScheduling()
+{
+  unsigned int bufferLength = 0;
+  int bufferCount = 0;
+  FMOD_RESULT result = system->getSoftwareFormat(&sampleRate, NULL, NULL);
 
-    lastExitToMainConfirmationMenuState = InterfaceLogic::exitToMainConfirmationMenu.state;
-  }
+  if (result == FMOD_OK)
+    result = system->getDSPBufferSize(&bufferLength, &bufferCount);
 
-  if (lastSettingsState != InterfaceLogic::settingsLogic.state)
+  if (result == FMOD_OK && sampleRate > 0)
   {
-    if (InterfaceLogic::settingsLogic.state == SettingsLogic::stShowing)
-      play(smpUiAnimIn);
-    else if (InterfaceLogic::settingsLogic.state == SettingsLogic::stHiding)
-      play(smpUiAnimOut);
-    else if (InterfaceLogic::settingsLogic.state == SettingsLogic::stKeyWaiting)
-      play(smpUiClick);
-
-    lastSettingsState = InterfaceLogic::settingsLogic.state;
+    bufferTime = double(bufferLength) / sampleRate;
+    scheduleDelay = maxEventAge + bufferTime;
   }
 
-  if (lastLeaderboardState != InterfaceLogic::leaderboardLogic.state)
-  {
-    if (InterfaceLogic::leaderboardLogic.state == LeaderboardLogic::stShowing)
-      play(smpUiAnimIn);
-    else if (InterfaceLogic::leaderboardLogic.state == LeaderboardLogic::stHiding)
-      play(smpUiAnimOut);
+  return result;
+}
 
-    lastLeaderboardState = InterfaceLogic::leaderboardLogic.state;
-  }
 
-  if (abs(lastSoundVolume - InterfaceLogic::settingsLogic.getSoundVolume()) > 0.001)
-  {
-    if (InterfaceLogic::settingsLogic.state == SettingsLogic::stVisible)
-    {
-      static double lastPlayedTimer = 0.0;
-      const double replayTime = 0.125;
+// without frame pacing the frame rate is not known, 60 Hz is assumed
+void Sound::setFramePeriod(double period)
+{
+  maxEventAge = period > 0.0 ? period : 1.0 / 60.0;
+  scheduleDelay = maxEventAge + bufferTime;
+}
 
-      if (PerfTime::timer - lastPlayedTimer > replayTime)
-      {
-        play(smpDrop);
-        lastPlayedTimer = PerfTime::timer;
-      }
-    }
 
-    lastSoundVolume = InterfaceLogic::settingsLogic.getSoundVolume();
-  }
+// older events start at once
+FMOD_RESULT Sound::scheduleStart(FMOD::Channel * channel, double time)
+{
+  double delay = time + scheduleDelay - PerfTime::getCurrentTimer();
 
-  if (lastMusicVolume != InterfaceLogic::settingsLogic.getMusicVolume())
-  {
-    if (musicChannel)
-      musicChannel->setVolume(InterfaceLogic::settingsLogic.getMusicVolume());
+  if (delay <= 0.0 || sampleRate <= 0)
+    return FMOD_OK;
 
-    lastMusicVolume = InterfaceLogic::settingsLogic.getMusicVolume();
-  }
+  unsigned long long parentClock = 0;
+  FMOD_RESULT result = channel->getDSPClock(NULL, &parentClock);
 
-  FMOD_RESULT result = system->update();
-  assert(result == FMOD_OK);
+  if (result == FMOD_OK)
+    result = channel->setDelay(parentClock + (unsigned long long)(delay * sampleRate), 0, false);
+
+  return result;
 }
 
 
-void Sound::quit()
+FMOD_RESULT Sound::createSample(const char * name, int flags, FMOD::Sound ** sample)
 {
-  initialized = false;
-  FMOD_RESULT result;
+  std::string fileName = soundPath + name;
+  const AssetPack::Entry * entry = AssetPack::find(fileName.c_str());
 
-  for (int i = 0; i < SAMPLE_COUNT; i++)
+  if (!entry)
+    return system->createSound((Crosy::getExePath() + fileName).c_str(), flags, 0, sample);
+
+  FMOD_CREATESOUNDEXINFO exinfo;
+  memset(&exinfo, 0, sizeof(exinfo));
+  exinfo.cbsize = sizeof(exinfo);
+  exinfo.length = (unsigned int)entry->size;
+  flags |= FMOD_OPENMEMORY_POINT;
+
+  if (entry->type == AssetPack::etPcm)
   {
-    result = samples[i]->release();
-    assert(result == FMOD_OK);
+    exinfo.numchannels = (int)entry->channels;
+    exinfo.defaultfrequency = (int)entry->frequency;
+    exinfo.format = FMOD_SOUND_FORMAT_PCMFLOAT;
+    flags |= FMOD_OPENRAW;
   }
 
-  result = system->release();
-  assert(result == FMOD_OK);
+  return system->createSound((const char *)AssetPack::getData(entry), flags, &exinfo, sample);
 }
 
 
-void Sound::play(Sample sample)
+// rapid left/right/down repeats replace their own oldest voice instead of piling up
+FMOD_RESULT Sound::setupVoiceLimits()
 {
-  FMOD_RESULT result = system->playSound(samples[sample], 0, false, &soundChannel);
-  assert(result == FMOD_OK);
+  const int maxMoveVoices = 4;
+  FMOD_RESULT result = FMOD_OK;
+
+  for (int i = 0; i < SAMPLE_COUNT && result == FMOD_OK; i++)
+    if (samples[i])
+    {
+      float frequency = 0.0f;
+      int priority = 0;
+      result = samples[i]->getDefaults(&frequency, &priority);
+
+      if (result == FMOD_OK)
+        result = samples[i]->setDefaults(frequency, samplePriorities[i]);
+    }
 
   if (result == FMOD_OK)
-  {
-    result = soundChannel->setVolume(InterfaceLogic::settingsLogic.getSoundVolume());
-    assert(result == FMOD_OK);
-  }
-}
+    result = system->createSoundGroup("moves", &moveGroup);
 
-void Sound::resetLastState()
-{
-  lastFigureId = GameLogic::curFigure.id;
-  lastFigureX = GameLogic::curFigureX;
-  lastFigureAngle = GameLogic::curFigure.angle;
-  lastHoldFigureId = GameLogic::holdFigure.id;
-  lastFastDownCounter = GameLogic::fastDownCounter;
-  lastDropTrailCounter = GameLogic::dropTrailCounter;
-  lastDeletedRowsCount = GameLogic::getDeletedRowsCount();
-  lastLevel = GameLogic::curLevel;
-  lastCountdownTimeLeft = (int)GameLogic::countdownTimeLeft;
-  lastGameState = GameLogic::state;
-  lastMainMenuState = InterfaceLogic::mainMenu.state;
-  lastInGameMenuState = InterfaceLogic::inGameMenu.state;
-  lastQuitConfirmationMenuState = InterfaceLogic::quitConfirmationMenu.state;
-  lastRestartConfirmationMenuState = InterfaceLogic::restartConfirmationMenu.state;
-  lastExitToMainConfirmationMenuState = InterfaceLogic::exitToMainConfirmationMenu.state;
-  lastSettingsState = InterfaceLogic::settingsLogic.state;
-  lastLeaderboardState = InterfaceLogic::leaderboardLogic.state;
-  lastSoundVolume = InterfaceLogic::settingsLogic.getSoundVolume();
-  lastMusicVolume = InterfaceLogic::settingsLogic.getMusicVolume();
+  if (result == FMOD_OK)
+    result = moveGroup->setMaxAudible(maxMoveVoices);
+
+  if (result == FMOD_OK)
+    result = moveGroup->setMaxAudibleBehavior(FMOD_SOUNDGROUP_BEHAVIOR_STEALLOWEST);
+
+  const Sample moveSamples[] = { smpLeft, smpRight, smpDown };
+
+  for (Sample sample : moveSamples)
+    if (result == FMOD_OK && samples[sample])
+      result = samples[sample]->setSoundGroup(moveGroup);
+
+  return result;
 }
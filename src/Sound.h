@@ -25,40 +25,32 @@ public:
   static void init();
   static void update();
   static void quit();
-  static void play(Sample sample);
+  static void play(Sample sample, double time);
+  // longest time from an event to Sound::update, the frame period; 0 when it is not known
+  static void setFramePeriod(double period);
 
 private:
   static FMOD::Sound * samples[SAMPLE_COUNT];
   static FMOD::System * system;
   static FMOD::Channel * musicChannel;
   static FMOD::Channel * soundChannel;
+  static FMOD::SoundGroup * moveGroup;
+  static const int samplePriorities[SAMPLE_COUNT];
   static unsigned int version;
   static void * extradriverdata;
   static bool initialized;
+  static int sampleRate;
+  static double scheduleDelay;
+  static double maxEventAge;
+  static double bufferTime;
   static std::string soundPath;
-  static int lastFigureId;
-  static int lastFigureX;
-  static int lastFigureAngle;
-  static int lastHoldFigureId;
-  static unsigned int lastFastDownCounter;
-  static unsigned int lastDropTrailCounter;
-  static int lastDeletedRowsCount;
-  static int lastLevel;
-  static int lastCountdownTimeLeft;
-  static GameLogic::State lastGameState;
-  static MenuLogic::State lastMainMenuState;
-  static MenuLogic::State lastInGameMenuState;
-  static MenuLogic::State lastQuitConfirmationMenuState;
-  static MenuLogic::State lastRestartConfirmationMenuState;
-  static MenuLogic::State lastExitToMainConfirmationMenuState;
-  static SettingsLogic::State lastSettingsState;
-  static LeaderboardLogic::State lastLeaderboardState;
-  static float lastSoundVolume;
-  static float lastMusicVolume;
 
   Sound();
   ~Sound();
 
-  static void resetLastState();
+  static FMOD_RESULT createSample(const char * name, int flags, FMOD::Sound ** sample);
+  static FMOD_RESULT setupVoiceLimits();
+  static FMOD_RESULT setupScheduling();
+  static FMOD_RESULT scheduleStart(FMOD::Channel * channel, double time);
 };
 
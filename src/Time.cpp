@@ -21,6 +21,13 @@ void PerfTime::update()
 }
 
 
+double PerfTime::getCurrentTimer()
+{
+  assert(freq > 0);
+  return freq > 0 ? double(Crosy::getPerformanceCounter()) / double(freq) : timer;
+}
+
+
 float PerfTime::getCurrentTimerDelta()
 {
   assert(freq > 0);
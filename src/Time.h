@@ -14,4 +14,5 @@ public:
   static float timerDelta;
   static void update();
   static float getCurrentTimerDelta();
+  static double getCurrentTimer();
 };
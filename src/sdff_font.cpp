@@ -127,6 +127,12 @@ int SDFF_Font::load(const char * fileName)
   doc.ParseStream<rapidjson::FileReadStream>(frstream);
   fclose(file);
 
+  return load(doc);
+}
+
+
+int SDFF_Font::load(const rapidjson::Value & doc)
+{
   getJsonValue(doc, "Falloff", &falloff_);
   getJsonValue(doc, "MaxBearingY", &maxBearingY_);
   getJsonValue(doc, "MaxHeight", &maxHeight_);
@@ -17,6 +17,7 @@ public:
   float maxHeight() { return maxHeight_; };
   int save(const char * fileName) const;
   int load(const char * fileName);
+  int load(const rapidjson::Value & doc);
 
 private:
   struct CharPair
@@ -12,6 +12,12 @@
 #include <vector>
 #include <unordered_set>
 #include <map>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <memory>
 #include <assert.h>
 #include <stdint.h>
@@ -23,6 +29,7 @@
 #include "rapidjson/document.h"
 #include "rapidjson/filewritestream.h"
 #include "rapidjson/filereadstream.h"
+#include "rapidjson/memorystream.h"
 #include "rapidjson/prettywriter.h"
 #include "rapidjson/stringbuffer.h"
 
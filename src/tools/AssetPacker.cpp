@@ -0,0 +1,210 @@
+#include "static_headers.h"
+
+#include "../AssetPack.h"
+#include <algorithm>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define DR_WAV_IMPLEMENTATION
+#include "mm_core/dr_wav.h"
+#include "mm_core/mm_core.h"
+#include "mm_core/resampler.h"
+
+// Builds bin/assets.pak from the loose files under bin/.
+// usage: AssetPacker <bin directory> <output file>
+
+struct ManifestItem
+{
+  const char * name;
+  AssetPack::EntryType type;
+  int channels; // requested image channels
+};
+
+static const ManifestItem manifest[] =
+{
+  { "textures/BackgroundTile.png", AssetPack::etImage, 4 },
+  { "textures/MainAtlas.png", AssetPack::etImage, 4 },
+  { "fonts/MontserratTexture.png", AssetPack::etImage, 1 },
+  { "fonts/MontserratMetrics.json", AssetPack::etRaw, 0 },
+  { "layouts/default.json", AssetPack::etRaw, 0 },
+  { "palettes/default.json", AssetPack::etRaw, 0 },
+  { "sounds/countdown.wav", AssetPack::etPcm, 0 },
+  { "sounds/down.wav", AssetPack::etPcm, 0 },
+  { "sounds/drop.wav", AssetPack::etPcm, 0 },
+  { "sounds/hold.wav", AssetPack::etPcm, 0 },
+  { "sounds/left.wav", AssetPack::etPcm, 0 },
+  { "sounds/levelup.wav", AssetPack::etPcm, 0 },
+  { "sounds/right.wav", AssetPack::etPcm, 0 },
+  { "sounds/ui_enter.wav", AssetPack::etPcm, 0 },
+  { "sounds/ui_move.wav", AssetPack::etPcm, 0 },
+  { "sounds/wipe.wav", AssetPack::etPcm, 0 },
+  // music is streamed, kept compressed
+  { "sounds/music.mp3", AssetPack::etRaw, 0 },
+};
+
+struct PackItem
+{
+  AssetPack::Entry entry;
+  std::vector<unsigned char> data;
+
+  bool operator <(const PackItem & item) const { return strcmp(entry.name, item.entry.name) < 0; }
+};
+
+
+static bool readFile(const std::string & fileName, std::vector<unsigned char> & data)
+{
+  FILE * file = fopen(fileName.c_str(), "rb");
+
+  if (!file)
+    return false;
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  data.resize(size > 0 ? size : 0);
+  bool success = size > 0 && fread(data.data(), size, 1, file) == 1;
+  fclose(file);
+
+  return success;
+}
+
+
+static bool packImage(const std::string & fileName, int channels, PackItem & item)
+{
+  int width, height, fileChannels;
+  unsigned char * image = stbi_load(fileName.c_str(), &width, &height, &fileChannels, channels);
+
+  if (!image)
+    return false;
+
+  item.entry.width = width;
+  item.entry.height = height;
+  item.entry.channels = channels;
+  item.data.assign(image, image + width * height * channels);
+  stbi_image_free(image);
+
+  return true;
+}
+
+
+static bool packPcm(const std::string & fileName, PackItem & item)
+{
+  unsigned int channels = 0;
+  unsigned int sampleRate = 0;
+  drwav_uint64 totalSampleCount = 0;
+  float * samples = drwav_open_and_read_file_f32(fileName.c_str(), &channels, &sampleRate, &totalSampleCount);
+
+  if (!samples || !channels)
+    return false;
+
+  // stored in mixer format (stereo at MMC_FREQ), so the game maps it without conversion
+  std::vector<float> stereo;
+  bool success = resample_to_stereo(samples, size_t(totalSampleCount / channels), channels, sampleRate, MMC_FREQ, 
+                                    stereo);
+  drwav_free(samples);
+
+  if (!success)
+    return false;
+
+  item.entry.channels = 2;
+  item.entry.frequency = MMC_FREQ;
+  item.data.assign((const unsigned char *)stereo.data(), (const unsigned char *)(stereo.data() + stereo.size()));
+
+  return true;
+}
+
+
+int main(int argc, char ** argv)
+{
+  if (argc != 3)
+  {
+    std::cout << "usage: AssetPacker <bin directory> <output file>\n";
+    return 1;
+  }
+
+  std::string binPath = std::string(argv[1]) + "/";
+  std::vector<PackItem> items;
+
+  for (const ManifestItem & manifestItem : manifest)
+  {
+    items.push_back(PackItem());
+    PackItem & item = items.back();
+    memset(&item.entry, 0, sizeof(item.entry));
+    assert(strlen(manifestItem.name) < AssetPack::NAME_SIZE);
+    strncpy(item.entry.name, manifestItem.name, AssetPack::NAME_SIZE - 1);
+    item.entry.type = manifestItem.type;
+
+    std::string fileName = binPath + manifestItem.name;
+    bool success = false;
+
+    if (manifestItem.type == AssetPack::etImage)
+      success = packImage(fileName, manifestItem.channels, item);
+    else if (manifestItem.type == AssetPack::etPcm)
+      success = packPcm(fileName, item);
+    else
+      success = readFile(fileName, item.data);
+
+    if (!success)
+    {
+      std::cout << "ERROR: cannot pack '" << fileName << "'\n";
+      return 1;
+    }
+  }
+
+  std::sort(items.begin(), items.end());
+
+  const uint64_t alignment = AssetPack::DATA_ALIGNMENT;
+  uint64_t offset = sizeof(AssetPack::Header) + items.size() * sizeof(AssetPack::Entry);
+
+  for (PackItem & item : items)
+  {
+    offset = (offset + alignment - 1) / alignment * alignment;
+    item.entry.offset = offset;
+    item.entry.size = item.data.size();
+    offset += item.data.size();
+  }
+
+  FILE * file = fopen(argv[2], "wb");
+
+  if (!file)
+  {
+    std::cout << "ERROR: cannot create '" << argv[2] << "'\n";
+    return 1;
+  }
+
+  AssetPack::Header header;
+  memcpy(header.magic, "TPAK", 4);
+  header.version = AssetPack::VERSION;
+  header.entryCount = (uint32_t)items.size();
+  header.dataAlignment = AssetPack::DATA_ALIGNMENT;
+  bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+
+  for (const PackItem & item : items)
+    success = success && fwrite(&item.entry, sizeof(item.entry), 1, file) == 1;
+
+  const char padding[AssetPack::DATA_ALIGNMENT] = { 0 };
+
+  for (const PackItem & item : items)
+  {
+    long position = ftell(file);
+    success = success && position <= (long)item.entry.offset;
+
+    if (success && item.entry.offset > (uint64_t)position)
+      success = fwrite(padding, size_t(item.entry.offset - position), 1, file) == 1;
+
+    if (success && !item.data.empty())
+      success = fwrite(item.data.data(), item.data.size(), 1, file) == 1;
+  }
+
+  fclose(file);
+
+  if (!success)
+  {
+    std::cout << "ERROR: cannot write '" << argv[2] << "'\n";
+    return 1;
+  }
+
+  std::cout << "Packed " << items.size() << " assets, " << offset << " bytes\n";
+
+  return 0;
+}
@@ -0,0 +1,111 @@
+#include "static_headers.h"
+
+#include "../Crosy.h"
+#include "mm_core/mm_core.h"
+#include "mm_core/mix_kernel.h"
+
+// Mixer kernel benchmark, reports mixed voice-frames per second for every
+// kernel supported by the CPU and checks results against the scalar kernel.
+// usage: MixBench [seconds per case]
+
+static const int SOURCE_LENGTH = 1 << 20;
+static const int BUFFER_FRAMES = 1024;
+static const int OUTPUT_CHANNELS = 2;
+
+static std::vector<float> source((SOURCE_LENGTH + 1) * 2); // stereo with guard frame
+
+
+static void initVoices(std::vector<MixVoice> & voices, int count, double step)
+{
+  voices.resize(count);
+
+  for (int i = 0; i < count; i++)
+  {
+    MixVoice & v = voices[i];
+    memset(&v, 0, sizeof(v));
+    v.data = source.data();
+    v.step = uint64_t(step * MIX_FIXED_ONE);
+    v.pos = uint64_t(i * 977) << 32;
+    v.begin = 0;
+    v.end = uint64_t(SOURCE_LENGTH) << 32;
+    v.volume = 1.0f / count;
+    v.loop = true;
+    v.playing = true;
+  }
+}
+
+
+static double mixBuffers(std::vector<MixVoice> & voices, int buffers, std::vector<float> & acc,
+                         std::vector<float> & out)
+{
+  std::vector<MixVoice *> voicePtrs;
+
+  for (MixVoice & v : voices)
+    voicePtrs.push_back(&v);
+
+  uint64_t startCounter = Crosy::getPerformanceCounter();
+
+  for (int b = 0; b < buffers; b++)
+  {
+    memset(acc.data(), 0, acc.size() * sizeof(float));
+    mix_voices(acc.data(), BUFFER_FRAMES, voicePtrs.data(), (int)voicePtrs.size());
+    mix_output(out.data(), acc.data(), BUFFER_FRAMES, OUTPUT_CHANNELS);
+  }
+
+  return double(Crosy::getPerformanceCounter() - startCounter) / Crosy::getPerformanceFrequency();
+}
+
+
+int main(int argc, char ** argv)
+{
+  double caseTime = argc > 1 ? atof(argv[1]) : 0.25;
+
+  for (size_t i = 0; i < source.size(); i++)
+    source[i] = float(rand()) / RAND_MAX * 2.0f - 1.0f;
+
+  const int voiceCounts[] = { 1, 8, 32, 128 };
+  const double steps[] = { 1.0, 22050.0 / MMC_FREQ, 48000.0 / MMC_FREQ };
+  const MixKernelType kernels[] = { MIX_KERNEL_SCALAR, MIX_KERNEL_SSE2, MIX_KERNEL_AVX2 };
+  std::vector<float> acc(BUFFER_FRAMES * 2);
+  std::vector<float> out(BUFFER_FRAMES * OUTPUT_CHANNELS);
+  std::vector<float> reference(BUFFER_FRAMES * OUTPUT_CHANNELS);
+  std::vector<MixVoice> voices;
+
+  printf("%-8s %7s %8s %16s %10s\n", "kernel", "voices", "step", "voice-frames/s", "max diff");
+
+  for (double step : steps)
+    for (int voiceCount : voiceCounts)
+      for (MixKernelType kernel : kernels)
+      {
+        if (!mix_kernel_supported(kernel))
+          continue;
+
+        mix_kernel_select(kernel);
+
+        // one buffer from the same start state to compare with the scalar kernel
+        initVoices(voices, voiceCount, step);
+        mixBuffers(voices, 1, acc, out);
+
+        if (kernel == MIX_KERNEL_SCALAR)
+          reference = out;
+
+        float maxDiff = 0.0f;
+
+        for (size_t i = 0; i < out.size(); i++)
+          maxDiff = glm::max(maxDiff, fabsf(out[i] - reference[i]));
+
+        // calibrate the number of buffers to the requested time
+        int buffers = 16;
+
+        while (mixBuffers(voices, buffers, acc, out) < caseTime * 0.1 && buffers < (1 << 24))
+          buffers *= 2;
+
+        buffers *= 10;
+        double time = mixBuffers(voices, buffers, acc, out);
+        double rate = double(buffers) * BUFFER_FRAMES * voiceCount / time;
+
+        printf("%-8s %7d %8.4f %16.0f %10.2g\n", mix_kernel_name(kernel), voiceCount, step, rate, maxDiff);
+      }
+
+  return 0;
+}